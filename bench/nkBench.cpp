@@ -0,0 +1,536 @@
+/* nkBench.cpp
+Times the nkTools nodes against the DDImage stand-in over a matrix of
+sizes, settings and thread counts, and writes the results as JSON
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDImage/Iop.h"
+#include "DDImage/Knob.h"
+#include "DDImage/Row.h"
+#include "DDImage/Thread.h"
+#include "Dispatch.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifndef NKTOOLS_VERSION
+#define NKTOOLS_VERSION "unknown"
+#endif
+
+using namespace DD::Image;
+
+static const char* const USAGE =
+	"usage: nkBench [--sizes hd,4k,8k] [--threads 1,2,4] [--reps n]\n"
+	"               [--filter text] [--out file.json]\n"
+	"Renders every case at every size and thread count, keeps the fastest\n"
+	"of the reps, and writes JSON to --out or stdout.\n";
+
+struct Size {
+	const char* name;
+	int width, height;
+};
+
+static const Size SIZES[] = {
+	{ "hd", 1920, 1080 },
+	{ "4k", 3840, 2160 },
+	{ "8k", 7680, 4320 }
+};
+
+// what the source puts in the colour channels and in the dilate mask
+enum { IMAGE_NOISE, IMAGE_MATTE };
+enum { MASK_ZERO, MASK_SPARSE, MASK_FULL, MASK_ONES };
+
+static inline uint32_t hash2(int x, int y)
+{
+	uint32_t h = uint32_t(x) * 0x8da6b343u ^ uint32_t(y) * 0xd8163841u;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	return h;
+}
+
+static inline float unit(uint32_t h) { return float(h & 0xffff) * (1.0f / 65535.0f); }
+
+// smooth enough for a disparity field, and cheap next to the nodes
+static inline float triangle(int v, int period)
+{
+	const int m = v & (period - 1);
+	return float(m < period / 2 ? m : period - m) * (4.0f / period) - 1.0f;
+}
+
+/*! Procedural input: colour, a dilate mask and stereo disparity, with the
+ * frame in its hash so every rep misses the nodes' caches.
+ */
+class Source : public Iop {
+	int _width, _height;
+	int _image, _mask;
+	float _disparity;
+
+public:
+	Source(int width, int height, int image, int mask, float disparity)
+		: Iop(0), _width(width), _height(height), _image(image), _mask(mask), _disparity(disparity)
+	{
+		inputs(0);
+	}
+
+	const char* Class() const { return "nkBenchSource"; }
+	int minimum_inputs() const { return 0; }
+	int maximum_inputs() const { return 0; }
+
+	void append(Hash& hash)
+	{
+		hash.append(outputContext().frame());
+		hash.append(_width);
+		hash.append(_height);
+		hash.append(_image);
+		hash.append(_mask);
+		hash.append(_disparity);
+	}
+
+	void _validate(bool)
+	{
+		const Format format(_width, _height);
+		info_.format(format);
+		info_.full_size_format(format);
+		info_.set(format);
+		ChannelSet channels(Mask_RGBA);
+		channels += Chan_Mask;
+		channels += Chan_Stereo_Disp_Left_X;
+		channels += Chan_Stereo_Disp_Left_Y;
+		channels += Chan_Stereo_Disp_Right_X;
+		channels += Chan_Stereo_Disp_Right_Y;
+		info_.channels(channels);
+	}
+
+	void engine(int y, int x, int r, ChannelMask channels, Row& row)
+	{
+		foreach (z, channels){
+			float* out = row.writable(z);
+			for (int X=x; X < r; X++)
+				out[X] = pixel(z, X, y);
+		}
+	}
+
+	float pixel(Channel z, int x, int y) const
+	{
+		switch (z){
+		case Chan_Mask:
+			if (_mask == MASK_ZERO)
+				return 0.0f;
+			if (_mask == MASK_ONES)
+				return 1.0f;
+			if (_mask == MASK_SPARSE)
+				return hash2(x >> 6, y >> 6) % 50 == 0 ? 1.0f : 0.0f;
+			return 0.25f + 0.75f * unit(hash2(x >> 3, y >> 3));
+		case Chan_Stereo_Disp_Left_X:
+		case Chan_Stereo_Disp_Right_X:
+			return _disparity * triangle(x + y / 2, 512);
+		case Chan_Stereo_Disp_Left_Y:
+		case Chan_Stereo_Disp_Right_Y:
+			return 0.25f * _disparity * triangle(y + x / 4, 256);
+		default:
+			if (_image == IMAGE_MATTE)
+				return (hash2(x / 37, y / 37) & 1) ? 1.0f : 0.0f;
+			return unit(hash2(x, y * 4 + z));
+		}
+	}
+};
+
+struct KnobValue {
+	const char* name;
+	std::string script;
+};
+
+struct Case {
+	const char* node;
+	std::string name;
+	std::string params;     // JSON object body
+	std::vector<KnobValue> knobs;
+	int image, mask;
+	float disparity;
+	bool hasInput;
+	bool animate;           // nudge p0 per rep, so no rep reuses a cached ramp
+};
+
+static std::string format(const char* fmt, ...)
+{
+	char buffer[512];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+	return buffer;
+}
+
+static void knob(Case& c, const char* name, const std::string& script)
+{
+	KnobValue k = { name, script };
+	c.knobs.push_back(k);
+}
+
+static std::vector<Case> buildCases()
+{
+	std::vector<Case> cases;
+
+	static const char* const MASKS[] = { "zero", "sparse", "full", "binary" };
+	static const int RADII[] = { 5, 50 };
+	for (int ri=0; ri < 2; ri++){
+		for (int m=0; m < 4; m++){
+			for (int op=0; op < 2; op++){
+				const int radius = RADII[ri];
+				const char* opName = op ? "max" : "min";
+				Case c;
+				c.node = "DrivenDilate";
+				c.name = format("%s r%d %s", opName, radius, MASKS[m]);
+				c.params = format("\"op\": \"%s\", \"radius\": %d, \"mask\": \"%s\"", opName, radius, MASKS[m]);
+				c.image = m == 3 ? IMAGE_MATTE : IMAGE_NOISE;
+				c.mask = m == 3 ? MASK_ONES : m;
+				c.disparity = 0.0f;
+				c.hasInput = true;
+				c.animate = false;
+				const int size = op ? radius : -radius;
+				knob(c, "maskChannel", format("%d", int(Chan_Mask)));
+				knob(c, "size", format("%d %d", size, size));
+				cases.push_back(c);
+			}
+		}
+	}
+
+	static const int RANGES[] = { 16, 128 };
+	for (int ri=0; ri < 2; ri++){
+		for (int xy=0; xy < 2; xy++){
+			Case c;
+			c.node = "DisparityDistort";
+			c.name = format("%s range %d", xy ? "xy" : "x", RANGES[ri]);
+			c.params = format("\"axes\": \"%s\", \"range\": %d", xy ? "xy" : "x", RANGES[ri]);
+			c.image = IMAGE_NOISE;
+			c.mask = MASK_ZERO;
+			c.disparity = float(RANGES[ri]);
+			c.hasInput = true;
+			c.animate = false;
+			// only the planar pass pushes along Y
+			knob(c, "planar", xy ? "1" : "0");
+			cases.push_back(c);
+		}
+	}
+
+	// still ramps are served from the cache after the first rep
+	static const char* const MODES[] = { "linear", "radial", "angular" };
+	for (int mode=0; mode < 3; mode++){
+		for (int lut=0; lut < 2; lut++){
+			for (int still=0; still < 2; still++){
+				Case c;
+				c.node = "Ramp2";
+				c.name = format("%s lut %s%s", MODES[mode], lut ? "on" : "off", still ? " still" : "");
+				c.params = format("\"mode\": \"%s\", \"lut\": %s, \"still\": %s", MODES[mode],
+					lut ? "true" : "false", still ? "true" : "false");
+				c.image = IMAGE_NOISE;
+				c.mask = MASK_ZERO;
+				c.disparity = 0.0f;
+				c.hasInput = false;
+				c.animate = !still;
+				knob(c, "mode", format("%d", mode));
+				knob(c, "enable", lut ? "1" : "0");
+				knob(c, "col1", "1 0.5 0.25 1");
+				cases.push_back(c);
+			}
+		}
+	}
+	return cases;
+}
+
+static double now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+}
+
+// VmHWM only covers this case if the kernel let us reset it
+static bool resetPeak()
+{
+	FILE* f = fopen("/proc/self/clear_refs", "w");
+	if (!f)
+		return false;
+	const bool ok = fputs("5", f) >= 0;
+	return fclose(f) == 0 && ok;
+}
+
+static double peakMB()
+{
+	FILE* f = fopen("/proc/self/status", "r");
+	if (f){
+		char line[256];
+		long kb = -1;
+		while (fgets(line, sizeof(line), f))
+			if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+				break;
+		fclose(f);
+		if (kb >= 0)
+			return kb / 1024.0;
+	}
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+}
+
+struct RenderJob {
+	Iop* op;
+	int x, y, r, t;
+	ChannelSet channels;
+	volatile int next;
+	std::vector<double> sums;
+};
+
+static void renderThread(unsigned, unsigned, void* data)
+{
+	RenderJob& job = *static_cast<RenderJob*>(data);
+	Row row(job.x, job.r);
+	for (;;){
+		const int y = __sync_fetch_and_add(&job.next, 1);
+		if (y >= job.t)
+			break;
+		job.op->get(y, job.x, job.r, job.channels, row);
+		double sum = 0.0;
+		foreach (z, job.channels){
+			const float* in = row[z];
+			for (int x=job.x; x < job.r; x++)
+				sum += in[x];
+		}
+		job.sums[y - job.y] = sum;
+	}
+}
+
+struct Result {
+	double best, median, peak, checksum;
+	bool peakReset;
+	std::string error;
+};
+
+/*! Renders the format of one case, once per rep, each with a fresh node
+ * on a frame no other render used. Rows are handed out to the threads as
+ * Nuke would.
+ */
+static Result run(const Case& c, const Size& size, unsigned threads, int reps)
+{
+	static int serial = 0;
+
+	Result result;
+	result.peakReset = resetPeak();
+	result.checksum = 0.0;
+	Thread::numThreads = threads;
+
+	std::vector<double> times;
+	for (int rep=0; rep < reps; rep++){
+		const int frame = ++serial;
+		Source source(size.width, size.height, c.image, c.mask, c.disparity);
+		Iop* op = static_cast<Iop*>(Op::Description::find(c.node)->build(0));
+		OutputContext context;
+		context.setFrame(frame);
+		source.setOutputContext(context);
+		op->setOutputContext(context);
+		if (c.hasInput)
+			op->set_input(0, &source);
+
+		if (Knob* k = op->knob("format"))
+			k->from_script(format("%d %d", size.width, size.height).c_str());
+		if (op->knob("p0")){
+			op->knob("p0")->from_script(format("%g %g", c.animate ? frame * 1e-4 : 0.0, size.height * 0.5).c_str());
+			op->knob("p1")->from_script(format("%d %g", size.width, size.height * 0.5).c_str());
+		}
+		for (size_t i=0; i < c.knobs.size(); i++){
+			Knob* k = op->knob(c.knobs[i].name);
+			if (!k || !k->from_script(c.knobs[i].script.c_str()))
+				result.error = format("bad knob %s", c.knobs[i].name);
+		}
+
+		RenderJob job;
+		job.op = op;
+		job.x = 0;
+		job.y = 0;
+		job.r = size.width;
+		job.t = size.height;
+		job.channels = Mask_RGBA;
+		job.next = 0;
+		job.sums.assign(size.height, 0.0);
+
+		const double start = now();
+		op->validate(true);
+		op->request(job.x, job.y, job.r, job.t, job.channels, 1);
+		Thread::spawn(renderThread, threads, &job);
+		Thread::wait(&job);
+		times.push_back(now() - start);
+
+		if (op->errorMessage())
+			result.error = op->errorMessage();
+		double checksum = 0.0;
+		for (size_t i=0; i < job.sums.size(); i++)
+			checksum += job.sums[i];
+		result.checksum = checksum;
+		delete op;
+	}
+
+	std::sort(times.begin(), times.end());
+	result.best = times.front();
+	result.median = times[times.size() / 2];
+	result.peak = peakMB();
+	return result;
+}
+
+static std::vector<std::string> split(const char* text)
+{
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* p = text; ; p++){
+		if (!*p || *p == ','){
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+			if (!*p)
+				break;
+		} else {
+			item += *p;
+		}
+	}
+	return items;
+}
+
+static std::string escape(const std::string& s)
+{
+	std::string out;
+	for (size_t i=0; i < s.size(); i++){
+		if (s[i] == '"' || s[i] == '\\')
+			out += '\\';
+		out += s[i];
+	}
+	return out;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<Size> sizes(SIZES, SIZES + 3);
+	std::vector<unsigned> threads;
+	int reps = 3;
+	const char* filter = 0;
+	const char* outPath = 0;
+
+	for (int i=1; i < argc; i++){
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--sizes") && hasValue){
+			const std::vector<std::string> names = split(argv[++i]);
+			sizes.clear();
+			for (size_t n=0; n < names.size(); n++)
+				for (int s=0; s < 3; s++)
+					if (names[n] == SIZES[s].name)
+						sizes.push_back(SIZES[s]);
+		} else if (!strcmp(argv[i], "--threads") && hasValue){
+			const std::vector<std::string> counts = split(argv[++i]);
+			for (size_t n=0; n < counts.size(); n++)
+				if (atoi(counts[n].c_str()) > 0)
+					threads.push_back(atoi(counts[n].c_str()));
+		} else if (!strcmp(argv[i], "--reps") && hasValue){
+			reps = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--filter") && hasValue){
+			filter = argv[++i];
+		} else if (!strcmp(argv[i], "--out") && hasValue){
+			outPath = argv[++i];
+		} else {
+			fputs(USAGE, stderr);
+			return 1;
+		}
+	}
+	if (threads.empty()){
+		// 1, then doubling up to every core
+		for (unsigned n=1; n < Thread::numCPUs; n *= 2)
+			threads.push_back(n);
+		threads.push_back(Thread::numCPUs);
+	}
+	if (sizes.empty()){
+		fputs(USAGE, stderr);
+		return 1;
+	}
+
+	FILE* out = outPath ? fopen(outPath, "w") : stdout;
+	if (!out){
+		fprintf(stderr, "nkBench: cannot write %s\n", outPath);
+		return 1;
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"suite\": \"nkTools\",\n");
+	fprintf(out, "  \"version\": \"%s\",\n", NKTOOLS_VERSION);
+	fprintf(out, "  \"compiler\": \"%s\",\n", escape(__VERSION__).c_str());
+	fprintf(out, "  \"cpus\": %u,\n", Thread::numCPUs);
+	fprintf(out, "  \"isa\": \"%s\",\n", isaName(kernels().isa));
+	fprintf(out, "  \"reps\": %d,\n", reps);
+	fprintf(out, "  \"results\": [");
+
+	const std::vector<Case> cases = buildCases();
+	bool first = true;
+	for (size_t ci=0; ci < cases.size(); ci++){
+		const Case& c = cases[ci];
+		const std::string label = std::string(c.node) + " " + c.name;
+		if (filter && label.find(filter) == std::string::npos)
+			continue;
+		for (size_t si=0; si < sizes.size(); si++){
+			double single = 0.0;
+			for (size_t ti=0; ti < threads.size(); ti++){
+				const Result res = run(c, sizes[si], threads[ti], reps);
+				const double mpix = double(sizes[si].width) * sizes[si].height * 1e-6 / res.best;
+				if (threads[ti] == 1)
+					single = res.best;
+				fprintf(stderr, "%-32s %-3s %3u threads %9.4fs %9.1f Mpix/s %8.1f MB%s%s\n",
+					label.c_str(), sizes[si].name, threads[ti], res.best, mpix, res.peak,
+					res.error.empty() ? "" : "  ", res.error.c_str());
+
+				fprintf(out, "%s\n    {\"node\": \"%s\", \"case\": \"%s\", \"params\": {%s},\n",
+					first ? "" : ",", c.node, escape(c.name).c_str(), c.params.c_str());
+				fprintf(out, "     \"size\": \"%s\", \"width\": %d, \"height\": %d, \"threads\": %u,\n",
+					sizes[si].name, sizes[si].width, sizes[si].height, threads[ti]);
+				fprintf(out, "     \"seconds\": %.6f, \"seconds_median\": %.6f, \"mpix_per_s\": %.3f,",
+					res.best, res.median, mpix);
+				if (single > 0.0)
+					fprintf(out, " \"speedup\": %.3f, \"efficiency\": %.3f,",
+						single / res.best, single / res.best / threads[ti]);
+				fprintf(out, "\n     \"peak_rss_mb\": %.1f, \"peak_reset\": %s, \"checksum\": %.17g",
+					res.peak, res.peakReset ? "true" : "false", res.checksum);
+				if (!res.error.empty())
+					fprintf(out, ", \"error\": \"%s\"", escape(res.error).c_str());
+				fprintf(out, "}");
+				first = false;
+				fflush(out);
+			}
+		}
+	}
+	fprintf(out, "\n  ]\n}\n");
+	if (outPath)
+		fclose(out);
+	return 0;
+}
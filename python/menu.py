@@ -8,5 +8,6 @@ drawMenu.addCommand("Ramp2", "nuke.createNode('Ramp2')")
 filterMenu = nodeMenu.findItem("Filter")
 
 filterMenu.addCommand("Driven Dilate", "nuke.createNode('DrivenDilate')")
+filterMenu.addCommand("Disparity Distort", "nuke.createNode('DisparityDistort')")
 
 
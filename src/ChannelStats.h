@@ -0,0 +1,534 @@
+/* ChannelStats.h
+Per-frame channel statistics shared by the nkTools plugins
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_CHANNELSTATS_H
+#define NKTOOLS_CHANNELSTATS_H
+
+#include "DDImage/Iop.h"
+#include "DDImage/Row.h"
+#include "DDImage/Thread.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <xmmintrin.h>
+#include <limits>
+#include <string>
+#include <vector>
+
+/*! Makes sure a prepass runs once per open, however many engine threads
+ * ask for it. The first thread to arrive runs it; the others sleep on the
+ * lock until it is done.
+ */
+class PrepassOnce
+{
+	DD::Image::SignalLock _lock;
+	volatile int _state;
+
+public:
+	enum State { PENDING, RUNNING, DONE };
+
+	PrepassOnce() : _state(PENDING) {}
+
+	void reset() { _state = PENDING; }
+
+	/*! Returns true if the caller should run the prepass. Otherwise returns
+	 * once the prepass is done or op has been aborted.
+	 */
+	bool start(const DD::Image::Op& op)
+	{
+		if (_state == DONE){
+			__sync_synchronize();
+			return false;
+		}
+		DD::Image::Guard guard(_lock);
+		for (;;){
+			if (_state == DONE)
+				return false;
+			if (_state == PENDING){
+				_state = RUNNING;
+				return true;
+			}
+			if (op.aborted())
+				return false;
+			_lock.wait();
+		}
+	}
+
+	// marks the prepass finished, or lets the next thread retry it if not ok
+	void finish(bool ok)
+	{
+		DD::Image::Guard guard(_lock);
+		_state = ok ? DONE : PENDING;
+		_lock.signal();
+	}
+};
+
+/*! Channels worked out over the whole bbox at once, one plane after
+ * another, which the engine threads copy their rows from.
+ */
+struct EnginePlane
+{
+	DD::Image::ChannelSet channels;
+	std::vector<float> pixels;
+	int users;
+
+	EnginePlane() : users(0) {}
+};
+
+/*! Builds an op's EnginePlane once per open, however many engine threads
+ * ask for it. A channel the plane doesn't hold, because nothing requested
+ * it, gets a new plane built with it added while the other threads sleep
+ * on the lock, and the old plane is freed once no thread is copying from
+ * it.
+ */
+class EnginePlaneOnce
+{
+	DD::Image::SignalLock _lock;
+	EnginePlane* _plane;
+	bool _building;
+
+public:
+	EnginePlaneOnce() : _plane(0), _building(false) {}
+	~EnginePlaneOnce() { delete _plane; }
+
+	// drops the plane, with no engine threads running
+	void reset()
+	{
+		delete _plane;
+		_plane = 0;
+	}
+
+	/*! Returns the plane once it holds every channel in wanted, calling
+	 * op.buildPlane(channels, plane) to make one from the channels and
+	 * wanted if it doesn't, or null if that fails or op is aborted. Each
+	 * plane returned must be given back to release().
+	 */
+	template <class Op>
+	EnginePlane* acquire(Op& op, DD::Image::ChannelSet channels, const DD::Image::ChannelSet& wanted)
+	{
+		{
+			DD::Image::Guard guard(_lock);
+			for (;;){
+				if (_plane && _plane->channels.contains(wanted)){
+					_plane->users++;
+					return _plane;
+				}
+				if (!_building)
+					break;
+				if (op.aborted())
+					return 0;
+				_lock.wait();
+			}
+			_building = true;
+			channels += wanted;
+			if (_plane)
+				channels += _plane->channels;
+		}
+
+		EnginePlane* plane = new EnginePlane;
+		const bool built = op.buildPlane(channels, *plane);
+		DD::Image::Guard guard(_lock);
+		_building = false;
+		_lock.signal();
+		if (!built){
+			delete plane;
+			return 0;
+		}
+		if (_plane && !_plane->users)
+			delete _plane;
+		_plane = plane;
+		plane->users++;
+		return plane;
+	}
+
+	void release(EnginePlane* plane)
+	{
+		DD::Image::Guard guard(_lock);
+		if (!--plane->users && plane != _plane)
+			delete plane;
+	}
+};
+
+//! Widens lo/hi to cover the n values at p.
+inline void minMax(const float* p, int n, float& lo, float& hi)
+{
+	int i = 0;
+	if (n >= 4){
+		__m128 vlo = _mm_set1_ps(lo);
+		__m128 vhi = _mm_set1_ps(hi);
+		for (; i + 4 <= n; i += 4){
+			const __m128 v = _mm_loadu_ps(p + i);
+			vlo = _mm_min_ps(vlo, v);
+			vhi = _mm_max_ps(vhi, v);
+		}
+		float l[4], h[4];
+		_mm_storeu_ps(l, vlo);
+		_mm_storeu_ps(h, vhi);
+		for (int j=0; j < 4; j++){
+			lo = std::min(lo, l[j]);
+			hi = std::max(hi, h[j]);
+		}
+	}
+	for (; i < n; i++){
+		lo = std::min(lo, p[i]);
+		hi = std::max(hi, p[i]);
+	}
+}
+
+/*! Min and max of each channel over square blocks of a region, stored
+ * block by block with one value per channel.
+ */
+struct ChannelBlocks
+{
+	int size;
+	int cols, rows;
+	std::vector<float> lo, hi;
+
+	ChannelBlocks(int blockSize = 32) : size(blockSize), cols(0), rows(0) {}
+};
+
+/*! Coarse pyramid of block maxima over a region, bounding a value over any
+ * rectangle without touching its pixels. Level 0 holds one value per block
+ * and each level above halves the resolution.
+ */
+class MaxPyramid
+{
+	int _x, _y, _r, _t;
+	int _blockSize;
+	std::vector<int> _cols, _rows;
+	std::vector<std::vector<float> > _levels;
+	float _max;
+
+public:
+	// largest number of blocks per axis scanned by query()
+	enum { QUERY_SPAN = 8 };
+
+	MaxPyramid() : _x(0), _y(0), _r(0), _t(0), _blockSize(1), _max(0.0f) {}
+
+	bool empty() const { return _levels.empty(); }
+	float max() const { return _max; }
+
+	void clear()
+	{
+		_levels.clear();
+		_cols.clear();
+		_rows.clear();
+		_max = 0.0f;
+	}
+
+	/*! Builds the pyramid for region [x, r) x [y, t) from its block maxima,
+	 * cols x rows of them laid out row by row.
+	 */
+	void build(int x, int y, int r, int t, int blockSize, int cols, int rows, const float* values)
+	{
+		clear();
+		if (cols <= 0 || rows <= 0)
+			return;
+		_x = x;
+		_y = y;
+		_r = r;
+		_t = t;
+		_blockSize = blockSize;
+		_levels.push_back(std::vector<float>(values, values + cols * rows));
+		_cols.push_back(cols);
+		_rows.push_back(rows);
+		while (cols > 1 || rows > 1){
+			const std::vector<float>& prev = _levels.back();
+			const int pc = cols;
+			const int pr = rows;
+			cols = (cols + 1) / 2;
+			rows = (rows + 1) / 2;
+			std::vector<float> level(cols * rows);
+			for (int j=0; j < rows; j++){
+				for (int i=0; i < cols; i++){
+					float m = prev[2 * j * pc + 2 * i];
+					if (2 * i + 1 < pc)
+						m = std::max(m, prev[2 * j * pc + 2 * i + 1]);
+					if (2 * j + 1 < pr){
+						m = std::max(m, prev[(2 * j + 1) * pc + 2 * i]);
+						if (2 * i + 1 < pc)
+							m = std::max(m, prev[(2 * j + 1) * pc + 2 * i + 1]);
+					}
+					level[j * cols + i] = m;
+				}
+			}
+			_levels.push_back(level);
+			_cols.push_back(cols);
+			_rows.push_back(rows);
+		}
+		_max = _levels.back()[0];
+	}
+
+	/*! Returns an upper bound of the values in [x, r) x [y, t). Only the
+	 * part inside the pyramid's region is considered; if there is none the
+	 * maximum of the whole region is returned.
+	 */
+	float query(int x, int y, int r, int t) const
+	{
+		if (empty())
+			return 0.0f;
+		x = std::max(x, _x);
+		y = std::max(y, _y);
+		r = std::min(r, _r);
+		t = std::min(t, _t);
+		if (x >= r || y >= t)
+			return _max;
+
+		int bx = (x - _x) / _blockSize;
+		int by = (y - _y) / _blockSize;
+		int br = (r - 1 - _x) / _blockSize + 1;
+		int bt = (t - 1 - _y) / _blockSize + 1;
+		size_t level = 0;
+		while ((br - bx > QUERY_SPAN || bt - by > QUERY_SPAN) && level + 1 < _levels.size()){
+			bx /= 2;
+			by /= 2;
+			br = (br + 1) / 2;
+			bt = (bt + 1) / 2;
+			level++;
+		}
+		const std::vector<float>& values = _levels[level];
+		const int cols = _cols[level];
+		float m = values[by * cols + bx];
+		for (int j = by; j < bt; j++)
+			for (int i = bx; i < br; i++)
+				m = std::max(m, values[j * cols + i]);
+		return m;
+	}
+};
+
+/*! State shared by the threads of channelStats(). Each thread keeps its
+ * own min/max per channel, which are combined once they have all finished.
+ * When blocks are wanted, each thread's band covers whole rows of blocks so
+ * no two threads write to the same block.
+ */
+struct ChannelStatsJob
+{
+	DD::Image::Iop* caller;
+	DD::Image::Iop* input;
+	int x, y, r, t;
+	DD::Image::ChannelSet channels;
+	int count;
+	std::vector<float> lo, hi;
+	ChannelBlocks* blocks;
+	volatile int rowsDone;
+	volatile bool aborted;
+};
+
+static void channelStatsThread(unsigned index, unsigned nThreads, void* data)
+{
+	ChannelStatsJob& job = *(ChannelStatsJob*)data;
+	const int rows = job.t - job.y;
+	ChannelBlocks* blocks = job.blocks;
+	int y0, y1;
+	if (blocks){
+		y0 = job.y + blocks->size * (int)((long long)blocks->rows * index / nThreads);
+		y1 = std::min(job.t, job.y + blocks->size * (int)((long long)blocks->rows * (index + 1) / nThreads));
+	} else {
+		y0 = job.y + (int)((long long)rows * index / nThreads);
+		y1 = job.y + (int)((long long)rows * (index + 1) / nThreads);
+	}
+	float* lo = &job.lo[index * job.count];
+	float* hi = &job.hi[index * job.count];
+
+	DD::Image::Row row(job.x, job.r);
+	for (int y = y0; y < y1; y++){
+		if (job.aborted || job.caller->aborted()){
+			job.aborted = true;
+			return;
+		}
+		row.get(*job.input, y, job.x, job.r, job.channels);
+		int i = 0;
+		foreach (z, job.channels){
+			const float* values = row[z];
+			if (blocks){
+				const int first = ((y - job.y) / blocks->size * blocks->cols) * job.count + i;
+				for (int b=0; b < blocks->cols; b++){
+					const int bx = job.x + b * blocks->size;
+					const int br = std::min(job.r, bx + blocks->size);
+					float blo = values[bx];
+					float bhi = values[bx];
+					minMax(values + bx, br - bx, blo, bhi);
+					float& tlo = blocks->lo[first + b * job.count];
+					float& thi = blocks->hi[first + b * job.count];
+					tlo = std::min(tlo, blo);
+					thi = std::max(thi, bhi);
+					lo[i] = std::min(lo[i], blo);
+					hi[i] = std::max(hi[i], bhi);
+				}
+			} else {
+				minMax(values + job.x, job.r - job.x, lo[i], hi[i]);
+			}
+			i++;
+		}
+		const int done = __sync_add_and_fetch(&job.rowsDone, 1);
+		if (index == 0)
+			job.caller->progressFraction(done, rows);
+	}
+}
+
+/*! Finds the min and max of each channel over rows [y, t) and columns
+ * [x, r) of input, with the rows split into one band per engine thread.
+ * lo and hi hold one value per channel, in channel order, and are only
+ * widened so the caller chooses their starting values. If blocks is given
+ * it is also filled in with the min and max of each of its blocks. Returns
+ * false if caller was aborted.
+ */
+inline bool channelStats(DD::Image::Iop& caller, DD::Image::Iop& input,
+	int x, int y, int r, int t, DD::Image::ChannelMask channels, float* lo, float* hi,
+	ChannelBlocks* blocks = 0)
+{
+	ChannelStatsJob job;
+	job.caller = &caller;
+	job.input = &input;
+	job.x = x;
+	job.y = y;
+	job.r = r;
+	job.t = t;
+	job.channels = channels;
+	job.count = channels.size();
+	job.blocks = blocks;
+	job.rowsDone = 0;
+	job.aborted = false;
+	if (blocks){
+		blocks->cols = x < r ? (r - x + blocks->size - 1) / blocks->size : 0;
+		blocks->rows = y < t ? (t - y + blocks->size - 1) / blocks->size : 0;
+		const size_t n = (size_t)blocks->cols * blocks->rows * job.count;
+		blocks->lo.assign(n, std::numeric_limits<float>::max());
+		blocks->hi.assign(n, -std::numeric_limits<float>::max());
+	}
+	if (!job.count || x >= r || y >= t)
+		return true;
+
+	const int bands = blocks ? blocks->rows : t - y;
+	const unsigned nThreads = std::max(1u, std::min(DD::Image::Thread::numThreads, (unsigned)bands));
+	for (unsigned i=0; i < nThreads; i++){
+		job.lo.insert(job.lo.end(), lo, lo + job.count);
+		job.hi.insert(job.hi.end(), hi, hi + job.count);
+	}
+	DD::Image::Thread::spawn(channelStatsThread, nThreads, &job);
+	DD::Image::Thread::wait(&job);
+	if (job.aborted)
+		return false;
+
+	for (unsigned i=0; i < nThreads; i++){
+		for (int c=0; c < job.count; c++){
+			lo[c] = std::min(lo[c], job.lo[i * job.count + c]);
+			hi[c] = std::max(hi[c], job.hi[i * job.count + c]);
+		}
+	}
+	return true;
+}
+
+/*! Prepass results kept on disk between renders, so a frame analysed once
+ * isn't analysed again by the next task or a retry. Each entry is a file in
+ * the directory named by NKTOOLS_STATS_CACHE, read back through mmap, and
+ * nothing is cached when the variable isn't set. The key should cover
+ * everything the values depend on, such as the input's hash.
+ */
+class StatsCache
+{
+	struct Header
+	{
+		char magic[8];
+		uint64_t key;
+		double frame;
+		unsigned count;
+	};
+
+	static bool path(const char* kind, uint64_t key, double frame, std::string& out)
+	{
+		const char* dir = getenv("NKTOOLS_STATS_CACHE");
+		if (!dir || !*dir)
+			return false;
+		char name[128];
+		snprintf(name, sizeof(name), "/%s_%016llx_%g.stats", kind, (unsigned long long)key, frame);
+		out = std::string(dir) + name;
+		return true;
+	}
+
+public:
+	//! Fills in values from the entry for key and frame, if there is one.
+	static bool load(const char* kind, uint64_t key, double frame, std::vector<float>& values)
+	{
+		std::string file;
+		if (!path(kind, key, frame, file))
+			return false;
+		const int fd = open(file.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header);
+		void* data = ok ? mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+		close(fd);
+		if (data == MAP_FAILED)
+			return false;
+
+		const Header& header = *(const Header*)data;
+		ok = !memcmp(header.magic, "NKSTATS1", 8) && header.key == key && header.frame == frame &&
+			(size_t)st.st_size == sizeof(Header) + header.count * sizeof(float);
+		if (ok){
+			const float* p = (const float*)((const char*)data + sizeof(Header));
+			values.assign(p, p + header.count);
+		}
+		munmap(data, st.st_size);
+		return ok;
+	}
+
+	/*! Writes the entry for key and frame. It is written to a temporary file
+	 * first, so other renders never see it half done.
+	 */
+	static void store(const char* kind, uint64_t key, double frame, const std::vector<float>& values)
+	{
+		std::string file;
+		if (!path(kind, key, frame, file))
+			return;
+		mkdir(getenv("NKTOOLS_STATS_CACHE"), 0777);
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), ".%d.%p.tmp", (int)getpid(), (const void*)&values);
+		const std::string temp = file + suffix;
+		FILE* f = fopen(temp.c_str(), "wb");
+		if (!f)
+			return;
+
+		Header header;
+		memcpy(header.magic, "NKSTATS1", 8);
+		header.key = key;
+		header.frame = frame;
+		header.count = values.size();
+		bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+		if (ok && !values.empty())
+			ok = fwrite(&values[0], sizeof(float), values.size(), f) == values.size();
+		ok = fclose(f) == 0 && ok;
+		if (!ok || rename(temp.c_str(), file.c_str()) != 0)
+			unlink(temp.c_str());
+	}
+};
+
+#endif
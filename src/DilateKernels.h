@@ -0,0 +1,348 @@
+/* DilateKernels.h
+Min/max and distance kernels behind DrivenDilate, on plain float buffers
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_DILATEKERNELS_H
+#define NKTOOLS_DILATEKERNELS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <xmmintrin.h>
+#include <algorithm>
+#include <vector>
+#include "Dispatch.h"
+
+//! Keeps the smaller of two values, for erodes.
+struct MinOp
+{
+	static float apply(float a, float b) { return a < b ? a : b; }
+	static __m128 apply(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+	static uint64_t apply(uint64_t a, uint64_t b) { return a & b; }
+};
+
+//! Keeps the larger of two values, for dilates.
+struct MaxOp
+{
+	static float apply(float a, float b) { return a > b ? a : b; }
+	static __m128 apply(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+	static uint64_t apply(uint64_t a, uint64_t b) { return a | b; }
+};
+
+//! Levels 1 and up of a sparse table of count entries, from level 0.
+template <class Op, class T>
+inline void buildLevels(Op, T* table, int count, int levels)
+{
+	T* level = table;
+	for (int k=1; k < levels; k++){
+		const T* prev = level;
+		level += count;
+		const int half = 1 << (k - 1);
+		const int n = count - (1 << k) + 1;
+		for (int i=0; i < n; i++)
+			level[i] = Op::apply(prev[i], prev[i + half]);
+	}
+}
+
+// the four channel tables go as wide as the cpu does
+inline void buildLevels(MinOp, __m128* table, int count, int levels)
+{
+	kernels().minLevels((float*)table, count, levels);
+}
+
+inline void buildLevels(MaxOp, __m128* table, int count, int levels)
+{
+	kernels().maxLevels((float*)table, count, levels);
+}
+
+/*! Sparse table answering min or max queries over a range of values in
+ * constant time, for four channels at once. Each entry interleaves one
+ * value from each channel, or holds 64 binary values packed into a word.
+ * Level k holds the extreme of the 2^k entries starting at each index, so
+ * any range is covered by two overlapping blocks.
+ */
+template <bool PACKED> struct TableEntry { typedef __m128 Type; };
+template <> struct TableEntry<true> { typedef uint64_t Type; };
+
+template <class Op, bool PACKED = false>
+class MinMaxTable
+{
+	typedef typename TableEntry<PACKED>::Type T;
+
+	T* _table;
+	size_t _capacity;
+	int _count;
+	int _levels;
+
+	MinMaxTable(const MinMaxTable&);
+	MinMaxTable& operator=(const MinMaxTable&);
+
+public:
+	MinMaxTable() : _table(0), _capacity(0), _count(0), _levels(0) {}
+	~MinMaxTable() { _mm_free(_table); }
+
+	static int log2Floor(unsigned v) { return 31 - __builtin_clz(v); }
+
+	/*! Sizes the table for count entries and returns them to be filled in
+	 * before build(). Only the levels needed for ranges up to maxLength
+	 * long are kept.
+	 */
+	T* reset(int count, int maxLength)
+	{
+		_count = count;
+		_levels = 0;
+		if (count <= 0)
+			return 0;
+		maxLength = std::max(1, std::min(maxLength, count));
+		_levels = log2Floor(maxLength) + 1;
+		const size_t size = (size_t)_levels * count;
+		if (size > _capacity){
+			_mm_free(_table);
+			_table = (T*)_mm_malloc(size * sizeof(T), sizeof(__m128));
+			_capacity = size;
+		}
+		return _table;
+	}
+
+	// fills in the levels above the entries given to reset()
+	void build() { buildLevels(Op(), _table, _count, _levels); }
+
+	// the entry at index i, as given to reset()
+	T at(int i) const { return _table[i]; }
+
+	/*! Returns the min/max of the entries in [l, r). The range must be
+	 * non-empty, inside the table and no longer than the maxLength given
+	 * to reset().
+	 */
+	T query(int l, int r) const
+	{
+		const int k = log2Floor(r - l);
+		const T* level = _table + (size_t)k * _count;
+		return Op::apply(level[l], level[r - (1 << k)]);
+	}
+};
+
+/*! Sparse table over a row of binary values packed 64 to a word. Each level
+ * is built from the one below with a shift and an AND or OR of whole words,
+ * so 64 pixels are handled per operation.
+ */
+template <class Op>
+class BitRowTable
+{
+	std::vector<uint64_t> _bits;
+	int _words;
+	int _levels;
+
+	bool bit(const uint64_t* level, int i) const { return (level[i >> 6] >> (i & 63)) & 1; }
+
+public:
+	BitRowTable() : _words(0), _levels(0) {}
+
+	/*! Sizes the table for count bits and returns the words to pack them
+	 * into before build(). Only the levels needed for ranges up to
+	 * maxLength long are kept.
+	 */
+	uint64_t* reset(int count, int maxLength)
+	{
+		_words = (count + 63) / 64;
+		maxLength = std::max(1, std::min(maxLength, count));
+		_levels = MinMaxTable<Op>::log2Floor(maxLength) + 1;
+		_bits.assign((size_t)_levels * _words + 1, 0);
+		return &_bits[0];
+	}
+
+	void build()
+	{
+		uint64_t* level = &_bits[0];
+		for (int k=1; k < _levels; k++){
+			const uint64_t* prev = level;
+			level += _words;
+			const int q = (1 << (k - 1)) >> 6;
+			const int b = (1 << (k - 1)) & 63;
+			for (int i=0; i < _words; i++){
+				// bits past the end are never queried, so zeros will do
+				const uint64_t lo = i + q < _words ? prev[i + q] : 0;
+				const uint64_t hi = i + q + 1 < _words ? prev[i + q + 1] : 0;
+				const uint64_t shifted = b ? (lo >> b) | (hi << (64 - b)) : lo;
+				level[i] = Op::apply(prev[i], shifted);
+			}
+		}
+	}
+
+	bool at(int i) const { return bit(&_bits[0], i); }
+
+	// same as MinMaxTable::query()
+	bool query(int l, int r) const
+	{
+		const int k = MinMaxTable<Op>::log2Floor(r - l);
+		const uint64_t* level = &_bits[(size_t)k * _words];
+		return Op::apply((uint64_t)bit(level, l), (uint64_t)bit(level, r - (1 << k))) != 0;
+	}
+};
+
+/*! Packs n values into bits, returning false if any of them is neither 0
+ * nor 1. If threshold is set, values above 0.5 count as 1 instead and it
+ * always succeeds.
+ */
+inline bool packBits(const float* p, int n, uint64_t* bits, bool threshold)
+{
+	return kernels().packBits(p, n, bits, threshold);
+}
+
+/*! Runs min/max windows along a line of count pixels, for up to four
+ * channels. Pixel i takes the extreme of itself and [starts[i], ends[i]),
+ * which may be empty, and no window is longer than maxLength. src and dst
+ * may be the same lines.
+ */
+template <class Op>
+inline void windowLine(const float* const* src, float* const* dst, int n, int count,
+	const int* starts, const int* ends, int maxLength, MinMaxTable<Op>& table)
+{
+	__m128* entries = table.reset(count, maxLength);
+	for (int i=0; i < count; i++)
+		entries[i] = _mm_setr_ps(src[0][i], src[1][i], src[2][i], src[3][i]);
+	table.build();
+	for (int i=0; i < count; i++){
+		__m128 v = table.at(i);
+		if (starts[i] < ends[i])
+			v = Op::apply(v, table.query(starts[i], ends[i]));
+		float lanes[4];
+		_mm_storeu_ps(lanes, v);
+		for (int c=0; c < n; c++)
+			dst[c][i] = lanes[c];
+	}
+}
+
+// width and height of the tiles the planar engine transposes
+static const int PLANE_TILE = 64;
+
+//! Copies one tile of a width x height plane into its transpose.
+inline void transposeTile(const float* src, float* dst, int width, int height, int tx, int ty)
+{
+	const int r = std::min(tx + PLANE_TILE, width);
+	const int t = std::min(ty + PLANE_TILE, height);
+	for (int y = ty; y < t; y++)
+		for (int x = tx; x < r; x++)
+			dst[(size_t)x * height + y] = src[(size_t)y * width + x];
+}
+
+// squared distance for pixels with nothing in reach
+static const float FAR_AWAY = 1e30f;
+
+/*! One dimensional squared distance transform by lower envelope of
+ * parabolas (Felzenszwalb & Huttenlocher), in linear time whatever the
+ * distances. Sets d[p] to the min over q of weight * (p - q)^2 + f[q] for
+ * n samples. A weight of 0 stands for a zero
+ * radius, where only q == p is in reach. v and z are scratch space for n
+ * and n + 1 values.
+ */
+inline void distanceTransform(const float* f, float* d, int n, double weight, int* v, double* z)
+{
+	if (weight <= 0.0){
+		for (int p=0; p < n; p++)
+			d[p] = f[p];
+		return;
+	}
+
+	int k = -1;
+	for (int q=0; q < n; q++){
+		const float fq = f[q];
+		if (fq >= FAR_AWAY)
+			continue;
+		const double hq = fq + weight * q * q;
+		double s = -HUGE_VAL;
+		while (k >= 0){
+			const int vk = v[k];
+			s = (hq - (f[vk] + weight * vk * vk)) / (2.0 * weight * (q - vk));
+			if (s > z[k])
+				break;
+			k--;
+		}
+		k++;
+		v[k] = q;
+		z[k] = k ? s : -HUGE_VAL;
+		z[k + 1] = HUGE_VAL;
+	}
+
+	if (k < 0){
+		for (int p=0; p < n; p++)
+			d[p] = FAR_AWAY;
+		return;
+	}
+	k = 0;
+	for (int p=0; p < n; p++){
+		while (z[k + 1] < p)
+			k++;
+		const int vk = v[k];
+		d[p] = (float)(weight * (p - vk) * (p - vk) + f[vk]);
+	}
+}
+
+/*! State shared by the threads working on one threshold of the round
+ * shape: a row pass into rowDist, then a column pass that lowers or raises
+ * result wherever the threshold is in reach.
+ */
+struct RoundJob
+{
+	int width, height;
+	const float* feature;
+	float* rowDist;
+	const float* reach;
+	float* result;
+	float threshold;
+	bool doMin;
+	bool columns;
+	double rowWeight, columnWeight;
+};
+
+inline void roundThread(unsigned index, unsigned nThreads, void* data)
+{
+	RoundJob& job = *(RoundJob*)data;
+	const int count = job.columns ? job.width : job.height;
+	const int length = job.columns ? job.height : job.width;
+	const int first = (int)((long long)count * index / nThreads);
+	const int last = (int)((long long)count * (index + 1) / nThreads);
+	std::vector<int> v(length);
+	std::vector<double> z(length + 1);
+	std::vector<float> column(length), dist(length);
+
+	for (int i = first; i < last; i++){
+		if (!job.columns){
+			distanceTransform(job.feature + i * job.width, job.rowDist + i * job.width,
+				length, job.rowWeight, &v[0], &z[0]);
+			continue;
+		}
+		for (int j=0; j < length; j++)
+			column[j] = job.rowDist[j * job.width + i];
+		distanceTransform(&column[0], &dist[0], length, job.columnWeight, &v[0], &z[0]);
+		for (int j=0; j < length; j++){
+			float& out = job.result[j * job.width + i];
+			if (dist[j] <= job.reach[j * job.width + i] &&
+				(job.doMin ? job.threshold < out : job.threshold > out))
+				out = job.threshold;
+		}
+	}
+}
+
+#endif
@@ -23,7 +23,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
 static const char* CLASS = "DisparityDistort";
-static const char* HELP= "Distorts an image by the disparity channel";
+static const char* HELP= "Distorts an image by the disparity channel\n\n"
+	"Each pixel is pushed along its disparity to where it lands in the other view. "
+	"Where several land on the same pixel the nearest one wins, and pixels nothing "
+	"lands on are left black, or filled from around them with fill on.";
 
 #include "DDImage/NukeWrapper.h"
 #include "DDImage/Row.h"
@@ -31,18 +34,82 @@ static const char* HELP= "Distorts an image by the disparity channel";
 #include "DDImage/Tile.h"
 #include "DDImage/DDMath.h"
 #include "DDImage/Thread.h"
+#include "ChannelStats.h"
+#include "WarpKernels.h"
+#include <stdint.h>
 #include <stdio.h>
+#include <vector>
 
 using namespace std;
 using namespace DD::Image;
 
+// height of the blocks the prepass finds each row's disparity range over
+static const int DISP_BLOCK = 32;
+
+static const char* const VIEWS[] = { "left", "right", "both", 0 };
+
+static const char* const WARPS[] = { "forward", "backward", 0 };
+enum { WARP_FORWARD, WARP_BACKWARD };
+
+static const char* const FILTERS[] = { "nearest", "bilinear", 0 };
+enum { FILTER_NEAREST, FILTER_BILINEAR };
+
+/*! The stats findMaxMin() gathered, and the planes a both views pass made,
+ * left by the op of one view for the op of the other, so it serves them
+ * rather than fetching and pushing the frame again. Each node keeps its own
+ * on its firstOp(), and lets go of them once the other view takes them or
+ * their key goes stale. The keys cover the input hash each view last
+ * validated with.
+ */
+struct StereoShare
+{
+	Lock lock;
+	uint64_t inputs[2];
+	uint64_t statsKey;
+	int statsView;
+	std::vector<float> stats;
+	uint64_t planeKey;
+	int planeView;
+	ChannelSet channels;
+	std::vector<float> plane;
+
+	StereoShare() : statsKey(0), statsView(0), planeKey(0), planeView(VIEW_LEFT)
+	{
+		inputs[0] = inputs[1] = 0;
+	}
+};
+
+typedef void (*ForwardKernel)(const float*, int, int, int, int, int*, float*);
+typedef void (*GatherKernel)(const float* const*, int, int, int, int, const float*, const float*, int, int, int, float*);
+
 class DisparityDistort : public Iop
 {
-	float _maxValue;
-	float _minValue;
-	bool _firstTime;
-	Lock _lock;
+	PrepassOnce _prepass;
+	// only used on the firstOp(), through stereoShare()
+	StereoShare _stereo;
 	Channel dispChans[4];
+	int _view;
+	// range of each disparity channel over each block of rows from _statsY,
+	// four channels per block row
+	int _statsY;
+	std::vector<float> _rowLo, _rowHi;
+	float _lo[4], _hi[4];
+	bool _planar;
+	ChannelSet _requested;
+	EnginePlaneOnce _plane;
+	int _warp;
+	// the backward warp's inverse disparity, X then Y planes over the bbox,
+	// kept between opens while its key doesn't change
+	PrepassOnce _inverseOnce;
+	uint64_t _inverseKey;
+	std::vector<float> _inverse;
+	int _filter;
+	bool _fill;
+	// kernels for the layout of the disparity, picked in _validate
+	Channel _dispX, _dispY;
+	Thread::ThreadFunction* _splat;
+	ForwardKernel _forward;
+	GatherKernel _gather;
 
 public:
 	int maximum_inputs() const {return 1; }
@@ -50,70 +117,325 @@ public:
 
 	DisparityDistort(Node* node) : Iop(node)
 	{
-		_maxValue = 0.0;
-		_minValue = 1.0;
-		_firstTime = true;
 		dispChans[0] = Chan_Stereo_Disp_Left_X;
 		dispChans[1] = Chan_Stereo_Disp_Left_Y;
 		dispChans[2] = Chan_Stereo_Disp_Right_X;
 		dispChans[3] = Chan_Stereo_Disp_Right_Y;
+		_view = VIEW_LEFT;
+		_statsY = 0;
+		for (int i=0; i < 4; i++)
+			_lo[i] = _hi[i] = 0.0f;
+		_planar = false;
+		_warp = WARP_FORWARD;
+		_inverseKey = 0;
+		_filter = FILTER_BILINEAR;
+		_fill = false;
+		_dispX = dispChans[0];
+		_dispY = Chan_Black;
+		_splat = splatThread<false, VIEW_LEFT>;
+		_forward = forwardRow<VIEW_LEFT>;
+		_gather = gatherRow<false, true>;
 	}
 
 	const char* Class() const {return CLASS; }
 	const char* node_help() const {return HELP;}
 	static const Op::Description d;
 
+	void knobs(Knob_Callback f)
+	{
+		Enumeration_knob(f, &_view, VIEWS, "view");
+		Tooltip(f, "Which view's disparity channels to push the image along. both pushes the whole frame along both at once, and renders the left one for the first view of the script and the right one for the second, serving whichever is rendered second from the first's pass.");
+		Enumeration_knob(f, &_warp, WARPS, "warp");
+		Tooltip(f, "forward pushes each pixel along its disparity. backward works out where each output pixel comes from once per frame, then samples the input there.");
+		Enumeration_knob(f, &_filter, FILTERS, "filter");
+		Tooltip(f, "How the backward warp samples the input.");
+		Bool_knob(f, &_planar, "planar");
+		Tooltip(f, "Pushes the whole frame at once, across all the threads, and along the Y disparity as well as X. Row by row only X is used.");
+		Bool_knob(f, &_fill, "fill");
+		Tooltip(f, "Fills the holes nothing lands on from the pixels around them, in time linear in the image size. The forward warp fills the image, which needs the whole frame at once. The backward warp fills its inverse disparity, so the holes sample the input too.");
+	}
+
 	void _open(){
-		_firstTime = true;
+		_prepass.reset();
+		_plane.reset();
+		_inverseOnce.reset();
+
+		// drop what the other view never took once it is out of date
+		if (stereo()){
+			StereoShare& share = stereoShare();
+			const uint64_t statsKey = statsShareKey();
+			const uint64_t planeKey = planeShareKey();
+			Guard guard(share.lock);
+			if (share.statsKey != statsKey){
+				std::vector<float>().swap(share.stats);
+				share.statsKey = 0;
+			}
+			if (share.planeKey != planeKey){
+				std::vector<float>().swap(share.plane);
+				share.planeKey = 0;
+			}
+		}
 	}
 
-	// finds the maximum/minimum values in the disparity channel
-	// @todo: adjust to get x max/min and y max/min
+	// finds the maximum/minimum values of each disparity channel, over the
+	// frame and over each block of rows
 	void findMaxMin(){
-		Guard guard(_lock);
-		if (_firstTime){
-			Format format = input0().format();
-			const int fx = format.x();
-			const int fy = format.y();
-			const int fr = format.r();
-			const int ft = format.t();
-			ChannelSet dchan;
-			for (int i=0; i < 4; i++){
-				dchan += dispChans[i];
+		if (!_prepass.start(*this))
+			return;
+		Format format = input0().format();
+		const ChannelSet dchan = disparityChannels();
+
+		// the cached stats are each channel's range, then its range over
+		// each block of rows
+		Hash key;
+		statsKey(key);
+		key.append(input0().hash().value());
+		const double frame = outputContext().frame();
+		const int view = outputContext().view();
+		const uint64_t shareKey = stereo() ? statsShareKey() : 0;
+		StereoShare& share = stereoShare();
+		std::vector<float> stats;
+		if (stereo()){
+			Guard guard(share.lock);
+			if (share.statsKey == shareKey && share.statsView != view){
+				stats.swap(share.stats);
+				share.statsKey = 0;
 			}
-			Interest interest(input0(), fx, fy, fr, ft, dchan, true);
-			interest.unlock();
-			for (int y=fy; y < ft; y++){
-				progressFraction(y, ft - fy);
-				Row row(fx, fr);
-				if (aborted())
-					return;
-				foreach (z, dchan)
-				{
-					row.get(input0(), y, fx, fr, z);
-					const float *cur = row[z] + fx;
-					const float *end = row[z] + fr;
-					while (cur < end){
-						_maxValue = std::max((float)*cur, _maxValue);
-						_minValue = std::min((float)*cur, _minValue);
-						cur++;
+		}
+		if (!stats.empty() || (StatsCache::load(CLASS, key.value(), frame, stats) && stats.size() >= 8 && stats.size() % 8 == 0)){
+			applyStats(stats);
+			_prepass.finish(true);
+			return;
+		}
+
+		std::vector<float> lo(dchan.size(), 1.0f);
+		std::vector<float> hi(dchan.size(), 0.0f);
+		ChannelBlocks blocks(DISP_BLOCK);
+		const bool ok = dchan.empty() || channelStats(*this, input0(), format.x(), format.y(),
+			format.r(), format.t(), dchan, &lo[0], &hi[0], &blocks);
+		if (ok){
+			stats.assign(8 * (1 + blocks.rows), 0.0f);
+			for (int i=0; i < 4; i++){
+				int c = 0;
+				foreach (z, dchan){
+					if (z == dispChans[i])
+						break;
+					c++;
+				}
+				if (c == (int)dchan.size())
+					continue;
+				stats[2 * i] = lo[c];
+				stats[2 * i + 1] = hi[c];
+				for (int b=0; b < blocks.rows; b++){
+					float blo = std::numeric_limits<float>::max();
+					float bhi = -std::numeric_limits<float>::max();
+					for (int col=0; col < blocks.cols; col++){
+						blo = std::min(blo, blocks.lo[(b * blocks.cols + col) * dchan.size() + c]);
+						bhi = std::max(bhi, blocks.hi[(b * blocks.cols + col) * dchan.size() + c]);
 					}
+					stats[8 * (b + 1) + 2 * i] = blo;
+					stats[8 * (b + 1) + 2 * i + 1] = bhi;
 				}
 			}
-			_firstTime = false;
+			applyStats(stats);
+			StatsCache::store(CLASS, key.value(), frame, stats);
+			if (stereo()){
+				Guard guard(share.lock);
+				share.statsKey = shareKey;
+				share.statsView = view;
+				share.stats = stats;
+			}
 		}
+		_prepass.finish(ok);
+	}
+
+	// Appends what findMaxMin()'s stats depend on, short of the input.
+	void statsKey(Hash& key)
+	{
+		foreach (z, disparityChannels())
+			key.append((int)z);
+		Format format = input0().format();
+		key.append(format.x());
+		key.append(format.y());
+		key.append(format.r());
+		key.append(format.t());
+		key.append(DISP_BLOCK);
+		key.append(outputContext().frame());
+	}
+
+	ChannelSet disparityChannels() const
+	{
+		ChannelSet dchan;
+		for (int i=0; i < 4; i++)
+			dchan += dispChans[i];
+		return dchan;
+	}
+
+	// Appends the inputs both views last validated with.
+	void appendInputs(Hash& key)
+	{
+		StereoShare& share = stereoShare();
+		Guard guard(share.lock);
+		key.append(share.inputs[VIEW_LEFT]);
+		key.append(share.inputs[VIEW_RIGHT]);
 	}
 
+	uint64_t statsShareKey()
+	{
+		Hash key;
+		statsKey(key);
+		appendInputs(key);
+		return key.value();
+	}
+
+	// What the planes of a both views pass depend on.
+	uint64_t planeShareKey()
+	{
+		Hash key;
+		key.append(outputContext().frame());
+		key.append(_planar);
+		key.append(_fill);
+		key.append(info_.x());
+		key.append(info_.y());
+		key.append(info_.r());
+		key.append(info_.t());
+		appendInputs(key);
+		return key.value();
+	}
+
+	// Sets up the disparity ranges from the stats findMaxMin() gathers.
+	void applyStats(const std::vector<float>& stats)
+	{
+		_statsY = input0().format().y();
+		for (int i=0; i < 4; i++){
+			_lo[i] = stats[2 * i];
+			_hi[i] = stats[2 * i + 1];
+		}
+		const int rows = stats.size() / 8 - 1;
+		_rowLo.resize(4 * rows);
+		_rowHi.resize(4 * rows);
+		for (int b=0; b < rows; b++){
+			for (int i=0; i < 4; i++){
+				_rowLo[4 * b + i] = stats[8 * (b + 1) + 2 * i];
+				_rowHi[4 * b + i] = stats[8 * (b + 1) + 2 * i + 1];
+			}
+		}
+	}
+
+	/*! Range of disparity channel i over rows [y, t), from the blocks of rows
+	 * the prepass covered. Rows it didn't cover get the whole frame's range.
+	 */
+	void rowRange(int i, int y, int t, float& lo, float& hi) const
+	{
+		const int rows = _rowLo.size() / 4;
+		const int first = (int)floor((y - _statsY) / (double)DISP_BLOCK);
+		const int last = (int)floor((t - 1 - _statsY) / (double)DISP_BLOCK);
+		if (first < 0 || last >= rows || first > last){
+			lo = _lo[i];
+			hi = _hi[i];
+			return;
+		}
+		lo = _rowLo[4 * first + i];
+		hi = _rowHi[4 * first + i];
+		for (int b = first + 1; b <= last; b++){
+			lo = std::min(lo, _rowLo[4 * b + i]);
+			hi = std::max(hi, _rowHi[4 * b + i]);
+		}
+	}
+
+	/*! Input columns that can land in output columns [x, r) on rows [y, t).
+	 * A pixel at X lands at X + d, so it takes X from x - hi to r - lo.
+	 */
+	void sourceColumns(int x, int y, int r, int t, int& sx, int& sr) const
+	{
+		float lo, hi;
+		rowRange(outputView() == VIEW_LEFT ? 0 : 2, y, t, lo, hi);
+		if (lo > hi)
+			lo = hi = 0.0f;
+		sx = x - (int)floor(hi + 0.5f);
+		sr = r - (int)floor(lo + 0.5f);
+	}
+
+	/*! Pixels the bbox grows by on the low and high sides for disparity
+	 * channel i, from its signed range.
+	 */
+	void padding(int i, int& low, int& high) const
+	{
+		low = high = 0;
+		if (_lo[i] > _hi[i])
+			return;
+		low = std::max(0, -(int)floor(_lo[i] + 0.5f));
+		high = std::max(0, (int)floor(_hi[i] + 0.5f));
+	}
+
+	/*! The view whose disparity this op pushes the image along. With both,
+	 * views are numbered from 1, so the second view of the script gets the
+	 * right one.
+	 */
+	int outputView() const
+	{
+		if (_view != VIEW_BOTH)
+			return _view;
+		return outputContext().view() == 2 ? VIEW_RIGHT : VIEW_LEFT;
+	}
+
+	// Whether both views are pushed together, in one pass over the frame.
+	bool stereo() const { return _view == VIEW_BOTH && _warp == WARP_FORWARD; }
+
 	void _validate(bool for_real){
-		std::cout << "validate" << std::endl;
 		copy_info();
-		float mst = std::max(fabs(_maxValue), fabs(_minValue));
-		info_.y(info_.y() - mst);
-		info_.t(info_.t() + mst);
-		info_.x(info_.x() - mst);
-		info_.r(info_.r() + mst);
+		if (stereo()){
+			StereoShare& share = stereoShare();
+			Guard guard(share.lock);
+			share.inputs[outputView()] = input0().hash().value();
+		}
+		// only the view's channels move pixels, and the row by row forward
+		// warp only moves them along X. A both views pass makes one plane
+		// for the two, so it covers both.
+		const int view = outputView();
+		const int first = view == VIEW_LEFT ? 0 : 2;
+		const ChannelSet& available = input0().info().channels();
+		const bool useY = _planar || _warp == WARP_BACKWARD;
+		_dispX = intersect(available, dispChans[first]) ? dispChans[first] : Chan_Black;
+		_dispY = useY && intersect(available, dispChans[first + 1]) ? dispChans[first + 1] : Chan_Black;
+		bool hasY = false;
+		int lowX = 0, highX = 0, lowY = 0, highY = 0;
+		for (int i=0; i < 4; i += 2){
+			if (i != first && !stereo())
+				continue;
+			int low, high;
+			padding(i, low, high);
+			lowX = std::max(lowX, low);
+			highX = std::max(highX, high);
+			if (useY && intersect(available, dispChans[i + 1])){
+				hasY = true;
+				padding(i + 1, low, high);
+				lowY = std::max(lowY, low);
+				highY = std::max(highY, high);
+			}
+		}
+		info_.x(info_.x() - lowX);
+		info_.r(info_.r() + highX);
+		info_.y(info_.y() - lowY);
+		info_.t(info_.t() + highY);
+
+		// pick the kernels once rather than checking the layout per pixel
+		if (stereo()){
+			_splat = hasY ? splatThread<true, VIEW_BOTH> : splatThread<false, VIEW_BOTH>;
+			_forward = forwardRow<VIEW_LEFT>;
+		} else if (view == VIEW_LEFT){
+			_splat = hasY ? splatThread<true, VIEW_LEFT> : splatThread<false, VIEW_LEFT>;
+			_forward = forwardRow<VIEW_LEFT>;
+		} else {
+			_splat = hasY ? splatThread<true, VIEW_RIGHT> : splatThread<false, VIEW_RIGHT>;
+			_forward = forwardRow<VIEW_RIGHT>;
+		}
+		if (_filter == FILTER_BILINEAR)
+			_gather = hasY ? gatherRow<true, true> : gatherRow<false, true>;
+		else
+			_gather = hasY ? gatherRow<true, false> : gatherRow<false, false>;
 		set_out_channels(Mask_All);
-		std::cout << info_.x() << " " << info_.r() << std::endl;
+		_requested = Mask_None;
 	}
 
 	void in_channels(int, ChannelSet &m) const {
@@ -123,18 +445,331 @@ public:
 	}
 
 	void _request(int x, int y, int r, int t, ChannelMask channels, int count){
-		std::cout << "request" << std::endl;
 		ChannelSet cl(channels);
 		in_channels(0, cl);
-		float mst = std::max(fabs(_maxValue), fabs(_minValue));
-		x -= mst;
-		r += mst;
-		y -= mst;
-		t += mst;
-		input0().request(x, y, r, t, cl, count);
-		std::cout << x << " " << y << " " << r << " " << t << std::endl;
+		_requested += cl;
+
+		// the planar mode, the fill and both views push the whole input at
+		// once, and the backward warp's inverse needs all of its disparity
+		if (_planar || _fill || stereo() || _warp == WARP_BACKWARD){
+			const Box& box = input0().info();
+			input0().request(box.x(), box.y(), box.r(), box.t(), cl, count);
+			return;
+		}
+
+		int sx, sr;
+		sourceColumns(x, y, r, t, sx, sr);
+		input0().request(sx, y, sr, t, cl, count);
+	}
+
+	// Runs the splat and gather passes of job on all the threads.
+	bool splat(SplatJob& job)
+	{
+		const unsigned nThreads = std::max(1u, Thread::numThreads);
+		job.nextRow = 0;
+		Thread::spawn(_splat, nThreads, &job);
+		Thread::wait(&job);
+		if (aborted())
+			return false;
+		job.nextRow = 0;
+		Thread::spawn(gatherThread, nThreads, &job);
+		Thread::wait(&job);
+		return !aborted();
+	}
+
+	/*! Pushes the whole input frame into the bbox, splatting from all the
+	 * threads and then gathering each output pixel's values. A both views
+	 * pass pushes it along both disparities from the one fetch, and leaves
+	 * the other view's planes for its op.
+	 */
+	bool buildPlane(ChannelSet channels, EnginePlane& plane)
+	{
+		const Box& box = input0().info();
+		in_channels(0, channels);
+		const int view = outputView();
+		const uint64_t key = stereo() ? planeShareKey() : 0;
+		if (stereo() && takePlane(key, view, channels, plane))
+			return true;
+		Tile tile(input0(), box.x(), box.y(), box.r(), box.t(), channels, true);
+		if (aborted())
+			return false;
+
+		SplatJob job;
+		job.views = stereo() ? 2 : 1;
+		job.sx = box.x();
+		job.sy = box.y();
+		job.sr = box.r();
+		job.st = box.t();
+		job.x = info_.x();
+		job.y = info_.y();
+		job.r = info_.r();
+		job.t = info_.t();
+		const size_t inSize = (size_t)(job.sr - job.sx) * (job.st - job.sy);
+		const size_t outSize = (size_t)(job.r - job.x) * (job.t - job.y);
+
+		// the tile's planes, copied so the threads can index them directly
+		plane.channels = channels;
+		std::vector<float> source(channels.size() * inSize);
+		float* dst = source.empty() ? 0 : &source[0];
+		foreach (z, channels){
+			for (int Y = job.sy; Y < job.st; Y++){
+				memcpy(dst, &tile[z][Y][job.sx], (job.sr - job.sx) * sizeof(float));
+				dst += job.sr - job.sx;
+			}
+		}
+		plane.pixels.assign(channels.size() * outSize, 0.0f);
+		std::vector<float> other(stereo() ? plane.pixels.size() : 0, 0.0f);
+		if (!inSize || !outSize)
+			return true;
+
+		int c = 0;
+		foreach (z, channels){
+			job.from.push_back(&source[c * inSize]);
+			c++;
+		}
+		job.count = c;
+		std::vector<float> zeros(inSize, 0.0f);
+		std::vector<std::vector<uint64_t> > winners(job.views, std::vector<uint64_t>(outSize, 0));
+		for (int v=0; v < job.views; v++){
+			// a both views pass has the left view first
+			const int first = 2 * (stereo() ? v : view);
+			float* to = stereo() && v != view ? &other[0] : &plane.pixels[0];
+			job.dispX[v] = job.dispY[v] = &zeros[0];
+			c = 0;
+			foreach (z, channels){
+				job.to[v].push_back(to + c * outSize);
+				if (z == dispChans[first] && intersect(tile.channels(), z))
+					job.dispX[v] = job.from[c];
+				if (z == dispChans[first + 1] && intersect(tile.channels(), z))
+					job.dispY[v] = job.from[c];
+				c++;
+			}
+			job.winners[v] = &winners[v][0];
+		}
+
+		if (!splat(job))
+			return false;
+		if (_fill){
+			std::vector<float> coverage(outSize);
+			for (int v=0; v < job.views; v++){
+				for (size_t p=0; p < outSize; p++)
+					coverage[p] = winners[v][p] ? 1.0f : 0.0f;
+				pushPull(&job.to[v][0], job.count, &coverage[0], job.r - job.x, job.t - job.y);
+			}
+		}
+		if (aborted())
+			return false;
+		if (stereo())
+			sharePlane(key, view == VIEW_LEFT ? VIEW_RIGHT : VIEW_LEFT, channels, other);
+		return true;
+	}
+
+	/*! What the ops of this node share between their views, or this op's
+	 * own if the node's first op isn't one, when nothing is shared.
+	 */
+	StereoShare& stereoShare()
+	{
+		Op* first = firstOp();
+		if (NukeWrapper* wrapper = dynamic_cast<NukeWrapper*>(first))
+			first = wrapper->wrapped_iop();
+		DisparityDistort* op = dynamic_cast<DisparityDistort*>(first);
+		return op ? op->_stereo : _stereo;
+	}
+
+	// Leaves the planes of view a both views pass made for its op.
+	void sharePlane(uint64_t key, int view, const ChannelSet& channels, std::vector<float>& plane)
+	{
+		StereoShare& share = stereoShare();
+		Guard guard(share.lock);
+		share.planeKey = key;
+		share.planeView = view;
+		share.channels = channels;
+		share.plane.swap(plane);
+		std::vector<float>().swap(plane);
+	}
+
+	/*! Takes the planes the other view's both views pass left for view, if
+	 * they are for the same frame and hold all of channels.
+	 */
+	bool takePlane(uint64_t key, int view, const ChannelSet& channels, EnginePlane& plane)
+	{
+		StereoShare& share = stereoShare();
+		Guard guard(share.lock);
+		if (share.planeKey != key || share.planeView != view)
+			return false;
+		foreach (z, channels){
+			if (!intersect(share.channels, z))
+				return false;
+		}
+		plane.channels = share.channels;
+		plane.pixels.swap(share.plane);
+		std::vector<float>().swap(share.plane);
+		share.planeKey = 0;
+		return true;
+	}
+
+	// Copies a row out of the plane built by buildPlane().
+	void enginePlane(int y, int x, int r, ChannelMask channels, Row& out)
+	{
+		EnginePlane* plane = _plane.acquire(*this, _requested, channels);
+		if (!plane)
+			return;
+
+		const int width = info_.r() - info_.x();
+		const size_t size = (size_t)width * (info_.t() - info_.y());
+		const float* src = plane->pixels.empty() ? 0 : &plane->pixels[0];
+		foreach (z, channels)
+			out.erase(z);
+		foreach (z, plane->channels){
+			if (intersect(channels, z)){
+				const float* row = src + (y - info_.y()) * width - info_.x();
+				memcpy(out.writable(z) + x, row + x, (r - x) * sizeof(float));
+			}
+			src += size;
+		}
+		_plane.release(plane);
 	}
 
+	/*! Works out the inverse disparity for the backward warp: the
+	 * disparity is pushed along itself, the same way as the planar splat,
+	 * so each output pixel holds the disparity of the input pixel landing
+	 * there, or NaN if none does. It is two full planes, so it is only
+	 * kept in memory, and reused while the input and view don't change.
+	 */
+	bool buildInverse()
+	{
+		const Box& box = input0().info();
+		const Channel xchan = _dispX;
+		const Channel ychan = _dispY;
+		Hash key;
+		key.append(input0().hash().value());
+		key.append((int)xchan);
+		key.append((int)ychan);
+		key.append(info_.x());
+		key.append(info_.y());
+		key.append(info_.r());
+		key.append(info_.t());
+		key.append(_fill);
+		key.append(outputContext().frame());
+		const size_t outSize = (size_t)(info_.r() - info_.x()) * (info_.t() - info_.y());
+		if (key.value() == _inverseKey && _inverse.size() == 2 * outSize)
+			return true;
+
+		ChannelSet channels(xchan);
+		channels += ychan;
+		channels -= Chan_Black;
+		Tile tile(input0(), box.x(), box.y(), box.r(), box.t(), channels, true);
+		if (aborted())
+			return false;
+
+		SplatJob job;
+		job.sx = box.x();
+		job.sy = box.y();
+		job.sr = box.r();
+		job.st = box.t();
+		job.x = info_.x();
+		job.y = info_.y();
+		job.r = info_.r();
+		job.t = info_.t();
+		const size_t inSize = (size_t)(job.sr - job.sx) * (job.st - job.sy);
+		std::vector<float> disp(2 * inSize, 0.0f);
+		for (int i=0; i < 2; i++){
+			const Channel z = i ? ychan : xchan;
+			if (!intersect(tile.channels(), z))
+				continue;
+			for (int Y = job.sy; Y < job.st; Y++)
+				memcpy(&disp[i * inSize + (size_t)(Y - job.sy) * (job.sr - job.sx)],
+					&tile[z][Y][job.sx], (job.sr - job.sx) * sizeof(float));
+		}
+		_inverse.assign(2 * outSize, std::numeric_limits<float>::quiet_NaN());
+		_inverseKey = 0;
+		if (!inSize || !outSize)
+			return true;
+
+		job.views = 1;
+		job.dispX[0] = &disp[0];
+		job.dispY[0] = &disp[inSize];
+		job.count = 2;
+		job.from.push_back(&disp[0]);
+		job.from.push_back(&disp[inSize]);
+		job.to[0].push_back(&_inverse[0]);
+		job.to[0].push_back(&_inverse[outSize]);
+		std::vector<uint64_t> winners(outSize, 0);
+		job.winners[0] = &winners[0];
+
+		if (!splat(job))
+			return false;
+		if (_fill){
+			std::vector<float> coverage(outSize);
+			for (size_t p=0; p < outSize; p++)
+				coverage[p] = _inverse[p] == _inverse[p] ? 1.0f : 0.0f;
+			pushPull(&job.to[0][0], job.count, &coverage[0], job.r - job.x, job.t - job.y);
+		}
+		_inverseKey = key.value();
+		return true;
+	}
+
+	/*! Samples the input for row y at the positions the inverse disparity
+	 * points to. Pixels with nothing landing on them are left black.
+	 */
+	void engineBackward(int y, int x, int r, ChannelMask channels, Row& out)
+	{
+		if (_inverseOnce.start(*this))
+			_inverseOnce.finish(buildInverse());
+		if (aborted())
+			return;
+		foreach (z, channels)
+			out.erase(z);
+		if (_inverse.empty())
+			return;
+
+		const int width = info_.r() - info_.x();
+		const size_t size = (size_t)width * (info_.t() - info_.y());
+		const float* invX = &_inverse[(size_t)(y - info_.y()) * width - info_.x()];
+		const float* invY = invX + size;
+
+		// the input pixels this row samples from
+		float loX = std::numeric_limits<float>::max();
+		float hiX = -loX;
+		float loY = loX;
+		float hiY = hiX;
+		for (int X = x; X < r; X++){
+			if (invX[X] != invX[X])
+				continue;
+			loX = std::min(loX, invX[X]);
+			hiX = std::max(hiX, invX[X]);
+			loY = std::min(loY, invY[X]);
+			hiY = std::max(hiY, invY[X]);
+		}
+		if (loX > hiX)
+			return;
+		// positions off the input clamp to its edge, so the tile keeps at
+		// least its edge pixel even when they all are
+		const Box& box = input0().info();
+		if (box.x() >= box.r() || box.y() >= box.t())
+			return;
+		const int tx = std::min(std::max(box.x(), (int)floor(x - hiX)), box.r() - 1);
+		const int tr = std::max(std::min(box.r(), (int)floor(r - 1 - loX) + 2), tx + 1);
+		const int ty = std::min(std::max(box.y(), (int)floor(y - hiY)), box.t() - 1);
+		const int tt = std::max(std::min(box.t(), (int)floor(y - loY) + 2), ty + 1);
+		Tile tile(input0(), tx, ty, tr, tt, channels);
+		if (aborted())
+			return;
+
+		std::vector<const float*> rows(tt - ty);
+		foreach (z, channels){
+			if (!intersect(tile.channels(), z))
+				continue;
+			for (int Y = ty; Y < tt; Y++)
+				rows[Y - ty] = tile[z][Y];
+			_gather(&rows[0], tx, ty, tr, tt, invX, invY, y, x, r, out.writable(z));
+		}
+	}
+
+	/*! Pushes each input pixel on row y along its disparity. Where several
+	 * land on the same output pixel the nearest wins: the one pushed furthest
+	 * left for the left view, furthest right for the right view.
+	 */
 	void engine(int y, int x, int r, ChannelMask channels, Row& out)
 	{
 		ChannelSet cl(channels);
@@ -142,41 +777,44 @@ public:
 		findMaxMin();
 		if (aborted())
 			return;
-		float mst = std::max(fabs(_maxValue), fabs(_minValue));
-		Row in(info_.x()-mst, info_.r()-mst);
-		if (aborted())
+
+		if (_warp == WARP_BACKWARD){
+			engineBackward(y, x, r, channels, out);
+			return;
+		}
+		if (_planar || _fill || stereo()){
+			enginePlane(y, x, r, channels, out);
 			return;
+		}
 
-		in.get(input0(), y, in.getLeft(), in.getRight(), cl);
+		// only input columns whose disparity can reach [x, r) are fetched
+		int sx, sr;
+		sourceColumns(x, y, r, y + 1, sx, sr);
+		sx = std::max(sx, input0().info().x());
+		sr = std::min(sr, input0().info().r());
+		foreach (z, channels)
+			out.erase(z);
+		if (sx >= sr || y < input0().info().y() || y >= input0().info().t())
+			return;
 
-		for (int i=0; i < 4; i++)
-		{
-			if (!intersect(in.writable_channels(), dispChans[i]))
-				dispChans[i] = Chan_Black;
-		}
+		Row in(sx, sr);
+		in.get(input0(), y, sx, sr, cl);
+		if (aborted())
+			return;
+
+		// find the source of each output pixel, as an offset from sx, since
+		// input columns left of 0 are negative
+		std::vector<int> source(r - x, -1);
+		std::vector<float> nearest(r - x);
+		_forward(in[_dispX], sx, sr, x, r, &source[0], &nearest[0]);
 
-		const float* dispLx = in[dispChans[0]];
-//		const float* dispLy = in[dispChans[1]];
-		const float* dispRx = in[dispChans[2]];
-//		const float* dispRy = in[dispChans[3]];
-		std::cout << "in  row: " << in.getLeft() << " " << in.getRight() << std::endl;
 		foreach(z, channels){
-			out.erase(z);
 			float* to = out.writable(z);
-			const float* from = in[z];
+			const float* from = in[z] + sx;
 			for (int X=x; X<r; X++){
-				int lval = int(dispLx[X] + .5);
-				int rval = int(dispRx[X] + .5);
-//				std::cout << "in  row: " << in.getLeft() << " " << in.getRight() << std::endl;
-//				std::cout << "out row: " << out.getLeft() << " " << out.getRight() << std::endl;
-//				std::cout << "X: " << X;
-//				std::cout << " lval: " << lval;
-//				std::cout <<" To: " << X + lval << std::endl;
-//				std::cout << "From: " << from[X];
-//				std::cout << " To: " << to[X + lval] << std::endl;
-
-//				to[X + lval] = from[X];
-				to[X] = from[X];
+				const int S = source[X - x];
+				if (S >= 0)
+					to[X] = from[S];
 			}
 		}
 	}
@@ -0,0 +1,136 @@
+/* Dispatch.cpp
+Picks the widest build of the kernels the cpu runs when the plugin loads
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Dispatch.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const NAMES[ISA_COUNT] = { "sse2", "avx2", "avx512" };
+
+#if defined(__GNUC__) && defined(__x86_64__)
+static void cpuid(unsigned leaf, unsigned sub, unsigned regs[4])
+{
+	__asm__ __volatile__("cpuid"
+		: "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+		: "a"(leaf), "c"(sub));
+}
+
+// the register state the os saves across context switches
+static uint64_t xcr0()
+{
+	unsigned lo, hi;
+	// xgetbv, spelt out for assemblers that predate it
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(lo), "=d"(hi) : "c"(0));
+	return (uint64_t)hi << 32 | lo;
+}
+
+/*! The widest set the cpu has and the os saves the registers of: the ymm
+ * halves for avx2, and the opmasks and zmm registers too for avx512.
+ */
+static Isa detectIsa()
+{
+	unsigned r[4];
+	cpuid(0, 0, r);
+	const unsigned maxLeaf = r[0];
+	cpuid(1, 0, r);
+	const bool osxsave = (r[2] >> 27) & 1;
+	const bool avx = (r[2] >> 28) & 1;
+	if (maxLeaf < 7 || !osxsave || !avx)
+		return ISA_SSE2;
+	const uint64_t state = xcr0();
+	cpuid(7, 0, r);
+	const bool avx2 = (r[1] >> 5) & 1;
+	const bool avx512f = (r[1] >> 16) & 1;
+	if (!avx2 || (state & 0x6) != 0x6)
+		return ISA_SSE2;
+	return avx512f && (state & 0xe6) == 0xe6 ? ISA_AVX512 : ISA_AVX2;
+}
+#else
+static Isa detectIsa() { return ISA_SSE2; }
+#endif
+
+static Isa cpuIsa()
+{
+	static const Isa isa = detectIsa();
+	return isa;
+}
+
+const char* isaName(Isa isa)
+{
+	return isa >= ISA_SSE2 && isa < ISA_COUNT ? NAMES[isa] : "unknown";
+}
+
+const Kernels* isaKernels(Isa isa)
+{
+	if (isa > cpuIsa())
+		return 0;
+	switch (isa){
+	case ISA_SSE2:
+		return sse2Kernels();
+#ifdef NKTOOLS_HAVE_AVX2
+	case ISA_AVX2:
+		return avx2Kernels();
+#endif
+#ifdef NKTOOLS_HAVE_AVX512
+	case ISA_AVX512:
+		return avx512Kernels();
+#endif
+	default:
+		return 0;
+	}
+}
+
+static const Kernels* pickKernels()
+{
+	int widest = ISA_COUNT - 1;
+	const char* env = getenv("NKTOOLS_ISA");
+	for (int i=0; env && i < ISA_COUNT; i++){
+		if (!strcmp(env, NAMES[i]))
+			widest = i;
+	}
+	for (int i = widest; i > ISA_SSE2; i--){
+		if (const Kernels* k = isaKernels(Isa(i)))
+			return k;
+	}
+	return sse2Kernels();
+}
+
+// picked as the plugin loads, or on first use if that comes sooner
+static const Kernels* current = pickKernels();
+
+const Kernels& kernels()
+{
+	if (!current)
+		current = pickKernels();
+	return *current;
+}
+
+bool useIsa(Isa isa)
+{
+	const Kernels* k = isaKernels(isa);
+	if (k)
+		current = k;
+	return k != 0;
+}
@@ -0,0 +1,68 @@
+/* Dispatch.h
+The hot kernels built once per instruction set, and the pick between them
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_DISPATCH_H
+#define NKTOOLS_DISPATCH_H
+
+#include <stdint.h>
+
+//! Instruction sets the kernels are built for, narrowest first.
+enum Isa { ISA_SSE2, ISA_AVX2, ISA_AVX512, ISA_COUNT };
+
+/*! One build of the kernels. Every build gives the same bits for the same
+ * input, so mixed machines render matching frames; see the kernel headers
+ * for what each one does.
+ */
+struct Kernels
+{
+	Isa isa;
+	// the levels above the first of a sparse table of four channel entries
+	void (*minLevels)(float* table, int count, int levels);
+	void (*maxLevels)(float* table, int count, int levels);
+	bool (*packBits)(const float* p, int n, uint64_t* bits, bool threshold);
+	void (*fillRamp)(float* out, int n, float start, float step, float lo, float hi);
+	void (*fillRadial)(float* out, int n, float dx, float dy, float scale);
+	void (*lookupTable)(const float* t, int n, const float* table, int size, float* out);
+};
+
+// one per build in DispatchKernels.cpp
+const Kernels* sse2Kernels();
+const Kernels* avx2Kernels();
+const Kernels* avx512Kernels();
+
+const char* isaName(Isa isa);
+
+//! isa's kernels, or null if they were not built or the cpu lacks isa.
+const Kernels* isaKernels(Isa isa);
+
+/*! The kernels in use, picked when the plugin loads: the widest the cpu
+ * runs, or no wider than NKTOOLS_ISA (sse2, avx2 or avx512) if it is set.
+ */
+const Kernels& kernels();
+
+//! Switches to isa's kernels, returning false if there are none.
+bool useIsa(Isa isa);
+
+#endif
@@ -0,0 +1,273 @@
+/* DispatchKernels.cpp
+The kernels in Dispatch.h, compiled once per instruction set: the Makefile
+builds this file with NKTOOLS_BUILD_SSE2, _AVX2 and _AVX512 in turn
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Dispatch.h"
+#include <math.h>
+
+#if defined(NKTOOLS_BUILD_AVX512)
+#ifndef __AVX512F__
+#error "NKTOOLS_BUILD_AVX512 needs -mavx512f"
+#endif
+#include <immintrin.h>
+#define KERNELS avx512Kernels
+#define KERNELS_ISA ISA_AVX512
+#elif defined(NKTOOLS_BUILD_AVX2)
+#ifndef __AVX2__
+#error "NKTOOLS_BUILD_AVX2 needs -mavx2"
+#endif
+#include <immintrin.h>
+#define KERNELS avx2Kernels
+#define KERNELS_ISA ISA_AVX2
+#else
+#include <emmintrin.h>
+#define KERNELS sse2Kernels
+#define KERNELS_ISA ISA_SSE2
+#endif
+
+namespace {
+
+/*! The few vector operations the kernels need, at the build's width. They
+ * round the same at every width, and the Makefile turns off contracting
+ * multiplies and adds into fmas, so every build gives the same bits.
+ */
+#if defined(NKTOOLS_BUILD_AVX512)
+typedef __m512 Vec;
+typedef __m512i Ints;
+const int WIDTH = 16;
+inline Vec set1(float v) { return _mm512_set1_ps(v); }
+inline Vec load(const float* p) { return _mm512_loadu_ps(p); }
+inline void store(float* p, Vec v) { _mm512_storeu_ps(p, v); }
+inline Vec add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm512_sub_ps(a, b); }
+inline Vec mul(Vec a, Vec b) { return _mm512_mul_ps(a, b); }
+inline Vec vmin(Vec a, Vec b) { return _mm512_min_ps(a, b); }
+inline Vec vmax(Vec a, Vec b) { return _mm512_max_ps(a, b); }
+inline Vec vsqrt(Vec a) { return _mm512_sqrt_ps(a); }
+inline unsigned greater(Vec a, Vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+inline unsigned equal(Vec a, Vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+inline Ints truncate(Vec a) { return _mm512_cvttps_epi32(a); }
+inline Ints imin(Ints a, int b) { return _mm512_min_epi32(a, _mm512_set1_epi32(b)); }
+inline Vec toFloat(Ints a) { return _mm512_cvtepi32_ps(a); }
+inline Vec gather(const float* base, Ints i) { return _mm512_i32gather_ps(i, base, 4); }
+inline Vec index(int i)
+{
+	const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	return _mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_set1_epi32(i), lanes));
+}
+#define HAVE_GATHER
+#elif defined(NKTOOLS_BUILD_AVX2)
+typedef __m256 Vec;
+typedef __m256i Ints;
+const int WIDTH = 8;
+inline Vec set1(float v) { return _mm256_set1_ps(v); }
+inline Vec load(const float* p) { return _mm256_loadu_ps(p); }
+inline void store(float* p, Vec v) { _mm256_storeu_ps(p, v); }
+inline Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+inline Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+inline Vec vmin(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+inline Vec vmax(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+inline Vec vsqrt(Vec a) { return _mm256_sqrt_ps(a); }
+inline unsigned greater(Vec a, Vec b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+inline unsigned equal(Vec a, Vec b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+inline Ints truncate(Vec a) { return _mm256_cvttps_epi32(a); }
+inline Ints imin(Ints a, int b) { return _mm256_min_epi32(a, _mm256_set1_epi32(b)); }
+inline Vec toFloat(Ints a) { return _mm256_cvtepi32_ps(a); }
+inline Vec gather(const float* base, Ints i) { return _mm256_i32gather_ps(base, i, 4); }
+inline Vec index(int i)
+{
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	return _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), lanes));
+}
+#define HAVE_GATHER
+#else
+typedef __m128 Vec;
+const int WIDTH = 4;
+inline Vec set1(float v) { return _mm_set1_ps(v); }
+inline Vec load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, Vec v) { _mm_storeu_ps(p, v); }
+inline Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+inline Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+inline Vec vmin(Vec a, Vec b) { return _mm_min_ps(a, b); }
+inline Vec vmax(Vec a, Vec b) { return _mm_max_ps(a, b); }
+inline Vec vsqrt(Vec a) { return _mm_sqrt_ps(a); }
+inline unsigned greater(Vec a, Vec b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+inline unsigned equal(Vec a, Vec b) { return _mm_movemask_ps(_mm_cmpeq_ps(a, b)); }
+inline Vec index(int i)
+{
+	return _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), _mm_setr_epi32(0, 1, 2, 3)));
+}
+#endif
+
+// every lane's bit from greater() or equal()
+const unsigned ALL_LANES = (1u << WIDTH) - 1;
+
+/*! Scalar min in this namespace rather than std::min, as std::min<int>
+ * and the like are weak symbols: any copy left out of line, as at -O0,
+ * could be the one the linker keeps for every build's object, wide
+ * instructions and all. Picks a the way std::min does when they tie.
+ */
+inline int lesser(int a, int b) { return b < a ? b : a; }
+inline float lesser(float a, float b) { return b < a ? b : a; }
+
+template <bool MIN>
+void levels(float* table, int count, int levels)
+{
+	float* level = table;
+	for (int k=1; k < levels; k++){
+		const float* prev = level;
+		level += 4 * count;
+		// both in floats, four to an entry
+		const int half = 4 << (k - 1);
+		const int n = 4 * (count - (1 << k) + 1);
+		int i = 0;
+		for (; i + WIDTH <= n; i += WIDTH){
+			const Vec a = load(prev + i);
+			const Vec b = load(prev + i + half);
+			store(level + i, MIN ? vmin(a, b) : vmax(a, b));
+		}
+		for (; i < n; i++){
+			const float a = prev[i];
+			const float b = prev[i + half];
+			level[i] = MIN ? (a < b ? a : b) : (a > b ? a : b);
+		}
+	}
+}
+
+void minLevels(float* table, int count, int n) { levels<true>(table, count, n); }
+void maxLevels(float* table, int count, int n) { levels<false>(table, count, n); }
+
+bool packBits(const float* p, int n, uint64_t* bits, bool threshold)
+{
+	const Vec zero = set1(0.0f);
+	const Vec one = set1(1.0f);
+	const Vec half = set1(0.5f);
+	for (int w=0; w * 64 < n; w++){
+		const float* q = p + w * 64;
+		const int count = lesser(64, n - w * 64);
+		uint64_t word = 0;
+		int i = 0;
+		for (; i + WIDTH <= count; i += WIDTH){
+			const Vec v = load(q + i);
+			uint64_t m;
+			if (threshold){
+				m = greater(v, half);
+			} else {
+				m = equal(v, one);
+				if ((m | equal(v, zero)) != ALL_LANES)
+					return false;
+			}
+			word |= m << i;
+		}
+		for (; i < count; i++){
+			const float v = q[i];
+			if (!threshold && v != 0.0f && v != 1.0f)
+				return false;
+			if (threshold ? v > 0.5f : v == 1.0f)
+				word |= (uint64_t)1 << i;
+		}
+		bits[w] = word;
+	}
+	return true;
+}
+
+void fillRamp(float* out, int n, float start, float step, float lo, float hi)
+{
+	const Vec vStart = set1(start);
+	const Vec vStep = set1(step);
+	const Vec vLo = set1(lo);
+	const Vec vHi = set1(hi);
+	int i = 0;
+	for (; i + WIDTH <= n; i += WIDTH)
+		store(out + i, vmin(vmax(add(vStart, mul(index(i), vStep)), vLo), vHi));
+	// in the order of the vector max and min, so NaN clamps to lo here too
+	for (; i < n; i++){
+		const float v = start + i * step;
+		const float above = v > lo ? v : lo;
+		out[i] = above < hi ? above : hi;
+	}
+}
+
+// each value from its own index rather than a running sum, so it is the
+// same whichever lane or tail works it out
+void fillRadial(float* out, int n, float dx, float dy, float scale)
+{
+	dy *= scale;
+	const float dy2 = dy * dy;
+	const Vec vDx = set1(dx);
+	const Vec vScale = set1(scale);
+	const Vec vDy2 = set1(dy2);
+	const Vec one = set1(1.0f);
+	int i = 0;
+	for (; i + WIDTH <= n; i += WIDTH){
+		const Vec d = mul(add(vDx, index(i)), vScale);
+		store(out + i, vmin(vsqrt(add(mul(d, d), vDy2)), one));
+	}
+	for (; i < n; i++){
+		const float d = (dx + i) * scale;
+		out[i] = lesser(sqrtf(d * d + dy2), 1.0f);
+	}
+}
+
+/*! Positions are clamped to [0, size] before they index the table, NaN
+ * going to size, so no position reads outside it. Without gathers, as in
+ * sse2, it is a plain loop.
+ */
+void lookupTable(const float* t, int n, const float* table, int size, float* out)
+{
+	const float fSize = float(size);
+	int i = 0;
+#ifdef HAVE_GATHER
+	const Vec vSize = set1(fSize);
+	const Vec zero = set1(0.0f);
+	for (; i + WIDTH <= n; i += WIDTH){
+		const Vec f = vmax(vmin(mul(load(t + i), vSize), vSize), zero);
+		const Ints j = imin(truncate(f), size - 1);
+		const Vec a = gather(table, j);
+		const Vec b = gather(table + 1, j);
+		store(out + i, add(a, mul(sub(b, a), sub(f, toFloat(j)))));
+	}
+#endif
+	// in the order of the vector min and max, which give NaN their second
+	for (; i < n; i++){
+		float f = t[i] * fSize;
+		f = f < fSize ? f : fSize;
+		f = f > 0.0f ? f : 0.0f;
+		const int j = lesser(int(f), size - 1);
+		out[i] = table[j] + (table[j + 1] - table[j]) * (f - j);
+	}
+}
+
+}
+
+const Kernels* KERNELS()
+{
+	static const Kernels kernels = {
+		KERNELS_ISA, minLevels, maxLevels, packBits, fillRamp, fillRadial, lookupTable
+	};
+	return &kernels;
+}
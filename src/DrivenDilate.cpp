@@ -34,24 +34,122 @@ static const char* HELP =
 #include "DDImage/Tile.h"
 #include "DDImage/DDMath.h"
 #include "DDImage/Thread.h"
+#include "ChannelStats.h"
+#include "DilateKernels.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <typeinfo>
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <vector>
+#include <xmmintrin.h>
 
 using namespace std;
 using namespace DD::Image;
 
+/*! A band of rows that have been through the vertical pass. Bands are shared
+ * by the engine threads: the first thread to need one sets up its source
+ * rows, and every thread that arrives while it is being built helps process
+ * its columns instead of waiting.
+ */
+struct VPassBand
+{
+	enum State { EMPTY, BUILDING, READY };
+
+	int index;
+	int x, r;
+	ChannelSet channels;
+	int users;
+	unsigned lastUse;
+	volatile int state;
+
+	// source rows, published by the building thread once they are loaded
+	volatile bool sourceReady;
+	int y0, y1;
+	int srcY, srcT;
+	int maskIndex;
+	std::vector<const float*> source;
+	volatile int nextColumn;
+	volatile int doneColumns;
+
+	std::vector<float> pixels;
+
+	VPassBand() : index(0), x(0), r(0), users(0), lastUse(0), state(EMPTY),
+		sourceReady(false), y0(0), y1(0), srcY(0), srcT(0), maskIndex(-1),
+		nextColumn(0), doneColumns(0) {}
+};
+
+/*! Ring buffer of input rows kept from one band to the next. When bands are
+ * built top to bottom the rows they overlap are reused, so each input row
+ * is only fetched once. It holds the rows of as many bands as the threads
+ * can be in at once, so the next band can load while the threads are still
+ * running the columns of the ones before.
+ */
+struct VPassStream
+{
+	int x, r;
+	ChannelSet channels;
+	int capacity;
+	int first, next; // rows [first, next) are loaded
+	Lock lock; // held while rows are loaded
+	std::vector<float> rows;
+	// first source row of each band still reading from the ring
+	Lock pinLock;
+	std::vector<int> pinned;
+
+	VPassStream() : x(0), r(0), capacity(0), first(0), next(0) {}
+
+	float* row(int y)
+	{
+		const int slot = ((y % capacity) + capacity) % capacity;
+		return &rows[(size_t)slot * channels.size() * (r - x)];
+	}
+};
+
+// smallest number of output rows computed together by the vertical pass
+static const int MIN_BAND_ROWS = 32;
+// width and height of the mask blocks summarised by the prepass pyramid
+static const int PYRAMID_BLOCK = 32;
+// number of columns a thread claims at a time when processing a band, which
+// is also the number of binary columns packed into a word
+static const int BAND_CHUNK = 64;
+
+static const char* const SHAPES[] = { "box", "round", 0 };
+enum { SHAPE_BOX, SHAPE_ROUND };
+
+static const char* const BINARY_MODES[] = { "auto", "off", "on", 0 };
+enum { BINARY_AUTO, BINARY_OFF, BINARY_ON };
+
 class DrivenDilate : public Iop
 {
     double w, h;
     int bboxAdjust;
     float _maxValue;
-    bool _firstTime;
-    Lock _lock;
+    PrepassOnce _prepass;
+    MaxPyramid _pyramid;
+	// the prepass key of the current input, and the one the pyramid is for
+	uint64_t _statsKey;
+	uint64_t _pyramidKey;
 	Channel maskChan[1];
 	int h_size;
 	int h_do_min;
 	int v_size;
 	int v_do_min;
+	bool _streamRows;
+	int _bandRows;
+	unsigned _bandClock;
+	// guards _bands, and wakes the threads waiting on one of them
+	SignalLock _bandLock;
+	std::vector<VPassBand*> _bands;
+	VPassStream _stream;
+	int _shape;
+	int _levels;
+	int _binary;
+	bool _planar;
+	ChannelSet _requested;
+	EnginePlaneOnce _plane;
 
 public:
 	int maximum_inputs() const { return 1; }
@@ -63,7 +161,20 @@ public:
 		bboxAdjust = 0;
 		maskChan[0] = Chan_Black;
 		_maxValue = 0.0;
-		_firstTime = true;
+		_statsKey = 0;
+		_pyramidKey = 0;
+		_streamRows = true;
+		_bandRows = MIN_BAND_ROWS;
+		_bandClock = 0;
+		_shape = SHAPE_BOX;
+		_levels = 16;
+		_binary = BINARY_AUTO;
+		_planar = false;
+	}
+
+	~DrivenDilate()
+	{
+		clearBands();
 	}
 
 	const char* Class() const { return CLASS; }
@@ -77,6 +188,16 @@ public:
     	Tooltip(f, "Controls the base size of the erode before using the multiplying channel.");
     	Int_knob(f, &bboxAdjust, "bbox");
     	Tooltip(f, "Manual control for extending the bounding box, if needed.");
+    	Bool_knob(f, &_streamRows, "streamRows", "stream rows");
+    	Tooltip(f, "Keeps the input rows of the vertical pass in a ring between bands, so the rows neighbouring bands share are only fetched once. A band the ring can't take, because it isn't the next one down or would overwrite rows still in use, fetches its own rows, which is slower but gives the same result.");
+    	Enumeration_knob(f, &_shape, SHAPES, "shape");
+    	Tooltip(f, "box runs separate horizontal and vertical passes. round uses an ellipse with the size scaled by each pixel's mask as its radii, taken exactly from that pixel's own mask value whatever the levels, and the sign of the width picks erode or dilate.");
+    	Int_knob(f, &_levels, "levels");
+    	Tooltip(f, "Number of channel value levels the round shape tracks. Only the values being dilated are quantised, never the radius: every pixel's ellipse is exact for its mask, at any levels. Channels with no more distinct values than this are exact. Others are quantised to this many even steps across their range, so the result can be off by up to one step, (max - min) / levels, towards the input. Raise it for more accuracy at the cost of speed.");
+    	Bool_knob(f, &_planar, "planar");
+    	Tooltip(f, "Works out the box shape for the whole bbox at once, in tiles shared between all the threads, instead of row by row. Faster on large frames with big sizes, but holds the frame in memory.");
+    	Enumeration_knob(f, &_binary, BINARY_MODES, "binary");
+    	Tooltip(f, "Runs the box shape on bits, 64 pixels at a time, for mattes that only hold 0 and 1. auto does this wherever the values allow, on treats everything above 0.5 as 1 and outputs a binary matte.");
     }
 
     static const Op::Description d;
@@ -88,25 +209,68 @@ public:
 		v_size = int(fabs(h) + .5);
 		v_do_min = h < 0;
 		copy_info();
-		info_.y(info_.y() - (bboxAdjust + std::max(h_size, (int)(h_size * _maxValue))));
-		info_.t(info_.t() + (bboxAdjust + std::max(v_size, (int)(v_size * _maxValue))));
-		info_.x(info_.x() - (bboxAdjust + std::max(h_size, (int)(h_size * _maxValue))));
-		info_.r(info_.r() + (bboxAdjust + std::max(v_size, (int)(v_size * _maxValue))));
+		_statsKey = statsKey();
+
+		// grow each side by the largest size the mask allows along that edge
+		const int bx = info_.x();
+		const int by = info_.y();
+		const int br = info_.r();
+		const int bt = info_.t();
+		info_.y(by - padding(v_size, localMax(bx, by, br, by + 1)));
+		info_.t(bt + padding(v_size, localMax(bx, bt - 1, br, bt)));
+		info_.x(bx - padding(h_size, localMax(bx, by, bx + 1, bt)));
+		info_.r(br + padding(h_size, localMax(br - 1, by, br, bt)));
 		set_out_channels(h_size || v_size ? Mask_All : Mask_None);
+		_requested = Mask_None;
 	}
 
 	void _request(int x, int y, int r, int t, ChannelMask channels, int count)
 	{
 		ChannelSet cl(channels);
 		in_channels(0, cl);
+		_requested += cl;
 
-		x -= bboxAdjust + std::max(h_size, (int)(h_size * _maxValue));
-		r += bboxAdjust + std::max(h_size, (int)(h_size * _maxValue));
-		y -= bboxAdjust + std::max(v_size, (int)(v_size * _maxValue));
-		t += bboxAdjust + std::max(v_size, (int)(v_size * _maxValue));
+		// the round and planar shapes are worked out over the whole bbox at once
+		if (_shape == SHAPE_ROUND || _planar){
+			input0().request(info_.x(), info_.y(), info_.r(), info_.t(), cl, count);
+			return;
+		}
+
+		// the vertical pass runs on every column the horizontal windows reach
+		const int hpad = padding(h_size, localMax(x, y, r, t));
+		x -= hpad;
+		r += hpad;
+		const int vpad = padding(v_size, localMax(x, y, r, t));
+		y -= vpad;
+		t += vpad;
 		input0().request(x, y, r, t, cl, count);
 	}
 
+	/*! Whether the pyramid is for the current input, and not left over from
+	 * another frame or mask.
+	 */
+	bool pyramidCurrent() const
+	{
+		return !_pyramid.empty() && _pyramidKey == _statsKey;
+	}
+
+	// Largest mask value over [x, r) x [y, t), as far as the prepass knows.
+	float localMax(int x, int y, int r, int t) const
+	{
+		return pyramidCurrent() ? _pyramid.query(x, y, r, t) : _maxValue;
+	}
+
+	/*! Pixels needed on each side of a region whose mask is at most maxValue.
+	 * Until the prepass has run on the current input at least the base size
+	 * is used.
+	 */
+	int padding(int size, float maxValue) const
+	{
+		if (!pyramidCurrent())
+			return bboxAdjust + std::max(size, (int)(size * _maxValue));
+		return bboxAdjust + (int)ceil(size * maxValue);
+	}
+
 	void in_channels(int, ChannelSet &m) const{
 		m += maskChan[0];
 	}
@@ -114,96 +278,856 @@ public:
 	// runs the vertical pass on the tile
 	void get_vpass(int y, int x, int r, ChannelMask channels, Row& out)
 	{
-		if (!v_size) {
+		// rows with no mask around them are a straight copy of the input
+		if (!v_size || y < info_.y() || y >= info_.t() || localMax(x, y, r, y + 1) == 0.0f) {
 		  input0().get(y, x, r, channels, out);
 		  return;
 		}
-		Channel mchan(maskChan[0]);
+
+		VPassBand* band = acquireBand((y - info_.y()) / _bandRows, x, r, channels);
+		if (band->state == VPassBand::READY){
+			const int width = r - x;
+			const int rows = band->y1 - band->y0;
+			const float* src = &band->pixels[0] + (y - band->y0) * width;
+			foreach (z, channels){
+				memcpy(out.writable(z) + x, src, width * sizeof(float));
+				src += rows * width;
+			}
+		}
+		releaseBand(band);
+	}
+
+	/*! Finds or claims the cached band with the given index and extents.
+	 * Returns once the band is ready or the render is aborted.
+	 */
+	VPassBand* acquireBand(int index, int x, int r, ChannelMask channels)
+	{
+		VPassBand* band = 0;
+		bool build = false;
+		{
+			Guard guard(_bandLock);
+			VPassBand* unused = 0;
+			for (size_t i=0; i < _bands.size(); i++){
+				VPassBand* b = _bands[i];
+				if (b->index == index && b->x == x && b->r == r && b->channels == channels){
+					band = b;
+					break;
+				}
+				if (!b->users && (!unused || b->lastUse < unused->lastUse))
+					unused = b;
+			}
+			if (!band){
+				if (unused && _bands.size() > Thread::numThreads){
+					band = unused;
+				} else {
+					band = new VPassBand;
+					_bands.push_back(band);
+				}
+				band->index = index;
+				band->x = x;
+				band->r = r;
+				band->channels = channels;
+				band->state = VPassBand::EMPTY;
+			}
+			if (band->state == VPassBand::EMPTY){
+				band->state = VPassBand::BUILDING;
+				band->sourceReady = false;
+				band->nextColumn = 0;
+				band->doneColumns = 0;
+				build = true;
+			}
+			band->users++;
+			band->lastUse = ++_bandClock;
+		}
+
+		if (build){
+			const bool built = buildBand(*band);
+			Guard guard(_bandLock);
+			band->state = built ? VPassBand::READY : VPassBand::EMPTY;
+			_bandLock.signal();
+			return band;
+		}
+		// help with the columns once the source is in, and sleep otherwise
+		for (;;){
+			if (band->sourceReady && processColumns(*band))
+				continue;
+			Guard guard(_bandLock);
+			if (band->state == VPassBand::READY || aborted())
+				break;
+			if (!band->sourceReady || band->nextColumn >= band->r - band->x)
+				_bandLock.wait();
+		}
+		return band;
+	}
+
+	void releaseBand(VPassBand* band)
+	{
+		Guard guard(_bandLock);
+		band->users--;
+	}
+
+	void clearBands()
+	{
+		for (size_t i=0; i < _bands.size(); i++)
+			delete _bands[i];
+		_bands.clear();
+		_stream.capacity = 0;
+	}
+
+	/*! Loads the band's source rows, either from a tile or the row stream,
+	 * and processes its columns together with any threads waiting on it.
+	 */
+	bool buildBand(VPassBand& band)
+	{
+		band.y0 = info_.y() + band.index * _bandRows;
+		band.y1 = std::min(band.y0 + _bandRows, info_.t());
+		// windows start at a truncated float, so can reach a row further up
+		const int radius = (int)ceil(v_size * localMax(band.x, band.y0, band.r, band.y1));
 
 		// determine max/min sizes of the tile
-		float tm = y - (v_size * _maxValue);
-		if (tm < info_.y())
-			tm = info_.y();
-		float tx = y + (v_size*_maxValue);
-		if (tx > info_.t())
-			tx = info_.t();
-		Tile tile(input0(), x, tm, r, tx + 1, channels);
+		const int ty = std::max(info_.y(), band.y0 - radius);
+		const int tt = std::min(info_.t(), band.y1 - 1 + radius) + 1;
+		band.srcY = ty;
+		band.srcT = tt;
+
+		const int width = band.r - band.x;
+		const int height = tt - ty;
+		band.source.resize((size_t)band.channels.size() * height);
+		band.pixels.resize((size_t)band.channels.size() * (band.y1 - band.y0) * width);
+
+		// a band the ring can't take fetches its own rows
+		if (_streamRows){
+			bool loaded;
+			{
+				Guard guard(_stream.lock);
+				loaded = loadStream(band);
+			}
+			if (loaded){
+				shareBand(band);
+				Guard guard(_stream.pinLock);
+				_stream.pinned.erase(std::find(_stream.pinned.begin(), _stream.pinned.end(), band.srcY));
+				return true;
+			}
+		}
+
+		Tile tile(input0(), band.x, ty, band.r, tt, band.channels, true);
 		if (aborted())
-			return;
+			return false;
+		band.maskIndex = -1;
+		int ci = 0;
+		foreach (z, band.channels){
+			if (z == maskChan[0] && intersect(tile.channels(), z))
+				band.maskIndex = ci;
+			for (int Y = ty; Y < tt; Y++)
+				band.source[ci * height + Y - ty] = &tile[z][Y][band.x] - band.x;
+			ci++;
+		}
+		shareBand(band);
+		return true;
+	}
+
+	/*! Brings the stream up to date with the band's source rows, fetching
+	 * only those not already held from the previous band, and pins them
+	 * until the band is done. Returns false if that would overwrite rows
+	 * another band is still reading, or the render is aborted.
+	 */
+	bool loadStream(VPassBand& band)
+	{
+		VPassStream& s = _stream;
+		const int width = band.r - band.x;
+		const int height = band.srcT - band.srcY;
+		// room for every band the threads can be in at once, and the rows
+		// the first of them reaches above
+		const int bands = 1 + ((int)Thread::numThreads + _bandRows - 1) / _bandRows;
+		const int capacity = bands * _bandRows + 2 * (int)ceil(v_size * _maxValue) + 1;
+		int lowest = std::numeric_limits<int>::max();
+		{
+			Guard guard(s.pinLock);
+			for (size_t i=0; i < s.pinned.size(); i++)
+				lowest = std::min(lowest, s.pinned[i]);
+		}
+		const bool idle = lowest == std::numeric_limits<int>::max();
+		if (s.x != band.x || s.r != band.r || s.channels != band.channels ||
+			s.capacity < height || band.srcY < s.first || band.srcY > s.next){
+			if (!idle)
+				return false;
+			s.x = band.x;
+			s.r = band.r;
+			s.channels = band.channels;
+			s.capacity = std::max(capacity, height);
+			s.rows.resize((size_t)s.capacity * s.channels.size() * width);
+			s.first = s.next = band.srcY;
+		}
+
+		// each row loaded takes the slot of the row capacity above it
+		if (band.srcT - s.capacity > lowest)
+			return false;
+		if (band.srcT > s.next){
+			const int from = s.next;
+			Tile tile(input0(), band.x, from, band.r, band.srcT, band.channels, true);
+			if (aborted()){
+				s.capacity = 0;
+				return false;
+			}
+			for (int Y = from; Y < band.srcT; Y++){
+				float* dst = s.row(Y);
+				foreach (z, band.channels){
+					if (intersect(tile.channels(), z))
+						memcpy(dst, &tile[z][Y][band.x], width * sizeof(float));
+					else
+						memset(dst, 0, width * sizeof(float));
+					dst += width;
+				}
+			}
+			s.next = band.srcT;
+			s.first = std::max(s.first, s.next - s.capacity);
+		}
 
-		if (!intersect(tile.channels(), mchan))
-			mchan = Chan_Black;
-		foreach (z, channels) {
-			if (z == mchan)
+		band.maskIndex = -1;
+		int ci = 0;
+		foreach (z, band.channels){
+			if (z == maskChan[0])
+				band.maskIndex = ci;
+			for (int Y = band.srcY; Y < band.srcT; Y++)
+				band.source[ci * height + Y - band.srcY] = s.row(Y) + ci * width - band.x;
+			ci++;
+		}
+		Guard guard(s.pinLock);
+		s.pinned.push_back(band.srcY);
+		return true;
+	}
+
+	/*! Publishes the band's source to waiting threads and processes columns
+	 * until every one of them has been written.
+	 */
+	void shareBand(VPassBand& band)
+	{
+		{
+			Guard guard(_bandLock);
+			band.sourceReady = true;
+			_bandLock.signal();
+		}
+		while (processColumns(band))
+			;
+		Guard guard(_bandLock);
+		while (band.doneColumns < band.r - band.x)
+			_bandLock.wait();
+		band.sourceReady = false;
+	}
+
+	/*! Runs the vertical pass for one chunk of the band's columns, returning
+	 * false once every chunk has been claimed.
+	 */
+	bool processColumns(VPassBand& band)
+	{
+		return v_do_min ? processColumns<MinOp>(band) : processColumns<MaxOp>(band);
+	}
+
+	/*! Each source column is loaded into a MinMaxTable once, four channels
+	 * at a time, then each row's window is a constant time lookup.
+	 */
+	template <class Op>
+	bool processColumns(VPassBand& band)
+	{
+		const int X0 = band.x + __sync_fetch_and_add(&band.nextColumn, BAND_CHUNK);
+		if (X0 >= band.r)
+			return false;
+		const int X1 = std::min(X0 + BAND_CHUNK, band.r);
+
+		const int width = band.r - band.x;
+		const int rows = band.y1 - band.y0;
+		const int height = band.srcT - band.srcY;
+		const int ty = band.srcY;
+		const int tt = band.srcT;
+		const float* const* mask = band.maskIndex < 0 ? 0 : &band.source[band.maskIndex * height];
+		const int columns = X1 - X0;
+		std::vector<int> starts(rows * columns), ends(rows * columns);
+		std::vector<char> identity(columns, 1);
+		MinMaxTable<Op> table;
+
+		// the mask passes through so the horizontal pass can use it
+		if (mask){
+			float* dst = &band.pixels[(size_t)band.maskIndex * rows * width] - band.x;
+			for (int Y = band.y0; Y < band.y1; Y++)
+				memcpy(dst + (Y - band.y0) * width + X0, mask[Y - ty] + X0, columns * sizeof(float));
+		}
+
+		// find each row's window, noting the columns where none of them
+		// does anything
+		for (int X = X0; X < X1; X++){
+			for (int Y = band.y0; Y < band.y1; Y++){
+				float mval = mask ? mask[Y - ty][X] : 0.0f;
+				int start = Y - (v_size*mval);
+				if (start < ty)
+					start = ty;
+				int end = Y + (v_size*mval);
+				if (end > tt)
+					end = tt;
+				if (start < end && (start != Y || end != Y + 1))
+					identity[X - X0] = 0;
+				starts[(X - X0) * rows + Y - band.y0] = start;
+				ends[(X - X0) * rows + Y - band.y0] = end;
+			}
+		}
+
+		// binary channels do the whole chunk at once, a word of bits per row
+		std::vector<int> dilated;
+		MinMaxTable<Op, true> bits;
+		for (int ci=0; ci < (int)band.channels.size(); ci++){
+			if (ci == band.maskIndex)
 				continue;
-			float* TO = out.writable(z);
-			int X;
-			int Y = tile.y();
-			for (X = tile.x(); X < tile.r(); X++)
-				TO[X] = tile[z][y][X];
-			// get vertical values
-			for (X=tile.x(); X < tile.r(); X++){
-				float mval = tile[mchan][y][X];
-				int start = y - (v_size*mval);
-				if (start < tile.y())
-					start = tile.y();
-				int end = y + (v_size*mval);
-				if (end > tile.t())
-					end = tile.t();
-
-				for (int Y=start; Y < end; Y++){
-					if (v_do_min){
-						if (tile[z][Y][X] < TO[X])
-							TO[X] = tile[z][Y][X];
-					} else {
-						if (tile[z][Y][X] > TO[X])
-							TO[X] = tile[z][Y][X];
-					}
+			const float* const* src = &band.source[ci * height];
+			uint64_t* words = _binary == BINARY_OFF ? 0 : bits.reset(height, height);
+			bool packed = words != 0;
+			for (int j=0; packed && j < height; j++)
+				packed = packBits(src[j] + X0, columns, words + j, _binary == BINARY_ON);
+			if (!packed){
+				dilated.push_back(ci);
+				continue;
+			}
+			bits.build();
+
+			float* dst = &band.pixels[(size_t)ci * rows * width] - band.x;
+			for (int X = X0; X < X1; X++){
+				const int bit = X - X0;
+				for (int Y = band.y0; Y < band.y1; Y++){
+					const int start = starts[bit * rows + Y - band.y0];
+					const int end = ends[bit * rows + Y - band.y0];
+					uint64_t v = bits.at(Y - ty);
+					if (start < end)
+						v = Op::apply(v, bits.query(start - ty, end - ty));
+					dst[(Y - band.y0) * width + X] = (float)((v >> bit) & 1);
+				}
+			}
+		}
+
+		// the other channels are processed in groups of four
+		for (int X = X0; X < X1; X++){
+			const int* rowStarts = &starts[(X - X0) * rows];
+			const int* rowEnds = &ends[(X - X0) * rows];
+			for (size_t g=0; g < dilated.size(); g += 4){
+				const int n = std::min(4, (int)(dilated.size() - g));
+				const float* const* src[4];
+				float* dst[4];
+				for (int c=0; c < 4; c++){
+					const int ci = dilated[g + std::min(c, n - 1)];
+					src[c] = &band.source[ci * height];
+					dst[c] = &band.pixels[(size_t)ci * rows * width] - band.x + X;
+				}
+				if (identity[X - X0]){
+					for (int c=0; c < n; c++)
+						for (int Y = band.y0; Y < band.y1; Y++)
+							dst[c][(Y - band.y0) * width] = src[c][Y - ty][X];
+					continue;
+				}
+
+				__m128* column = table.reset(height, height);
+				for (int j=0; j < height; j++)
+					column[j] = _mm_setr_ps(src[0][j][X], src[1][j][X], src[2][j][X], src[3][j][X]);
+				table.build();
+
+				// get vertical values
+				for (int Y = band.y0; Y < band.y1; Y++){
+					__m128 v = table.at(Y - ty);
+					const int start = rowStarts[Y - band.y0];
+					const int end = rowEnds[Y - band.y0];
+					if (start < end)
+						v = Op::apply(v, table.query(start - ty, end - ty));
+					float lanes[4];
+					_mm_storeu_ps(lanes, v);
+					for (int c=0; c < n; c++)
+						dst[c][(Y - band.y0) * width] = lanes[c];
 				}
 			}
-			// pad the ends that go outside the source:
-			for (X = x; X < tile.x(); X++)
-				TO[X] = TO[tile.x()];
-			for (X = tile.r(); X < r; X++)
-				TO[X] = TO[tile.r() - 1];
 		}
+		if (__sync_add_and_fetch(&band.doneColumns, X1 - X0) == band.r - band.x){
+			Guard guard(_bandLock);
+			_bandLock.signal();
+		}
+		return true;
 	}
 
 	void _open(){
-		_firstTime = true;
+		_prepass.reset();
+		_pyramid.clear();
+		_plane.reset();
+		Guard guard(_bandLock);
+		clearBands();
 	}
 
 	/*! Finds the maximum and minimum pixel value for the frame in the mask channel
 	 * This is then used to determine the maximum size of the bbox and vertical tile
 	 */
 	void findMaxMin(){
-		Guard guard(_lock);
-		if (_firstTime){
-			Format format = input0().format();
-			const int fx = format.x();
-			const int fy = format.y();
-			const int fr = format.r();
-			const int ft = format.t();
-			Channel mchan(*maskChan);
-			Interest interest(input0(), fx, fy, fr, ft, mchan, true);
-			interest.unlock();
-			_maxValue = 0.0;
-			for (int y = fy; y < ft; y++){
-				progressFraction(y, ft - fy);
-				Row row(fx, fr);
-				row.get(input0(), y, fx, fr, mchan);
-				if (aborted())
-					return;
+		if (!_prepass.start(*this))
+			return;
+		// over the input's bbox, as rows outside it repeat its edges
+		const Box& box = input0().info();
+
+		// the cached stats are the mask's range followed by its pyramid blocks
+		const double frame = outputContext().frame();
+		std::vector<float> stats;
+		if (StatsCache::load(CLASS, _statsKey, frame, stats) && stats.size() >= 4 &&
+			stats.size() == 4 + (size_t)stats[2] * (size_t)stats[3]){
+			applyStats(stats);
+			_prepass.finish(true);
+			return;
+		}
+
+		float lo = 0.0f;
+		float hi = 0.0f;
+		ChannelBlocks blocks(PYRAMID_BLOCK);
+		const bool ok = channelStats(*this, input0(), box.x(), box.y(), box.r(), box.t(),
+			ChannelSet(maskChan[0]), &lo, &hi, &blocks);
+		if (ok){
+			// the windows only depend on the size of the mask values
+			stats.resize(4 + blocks.lo.size());
+			stats[0] = lo;
+			stats[1] = hi;
+			stats[2] = blocks.cols;
+			stats[3] = blocks.rows;
+			for (size_t i=0; i < blocks.lo.size(); i++)
+				stats[4 + i] = std::max(-blocks.lo[i], blocks.hi[i]);
+			applyStats(stats);
+			StatsCache::store(CLASS, _statsKey, frame, stats);
+		}
+		_prepass.finish(ok);
+	}
+
+	// What the prepass depends on: the input, the mask channel and the bbox.
+	uint64_t statsKey()
+	{
+		const Box& box = input0().info();
+		Hash key;
+		key.append(input0().hash().value());
+		key.append((int)maskChan[0]);
+		key.append(box.x());
+		key.append(box.y());
+		key.append(box.r());
+		key.append(box.t());
+		key.append(PYRAMID_BLOCK);
+		return key.value();
+	}
+
+	// Sets up the max value and pyramid from the stats findMaxMin() gathers.
+	void applyStats(const std::vector<float>& stats)
+	{
+		const Box& box = input0().info();
+		_maxValue = std::max(-stats[0], stats[1]);
+		_bandRows = std::max(MIN_BAND_ROWS, 2 * (int)(v_size * _maxValue));
+		_pyramidKey = _statsKey;
+		if (stats.size() == 4)
+			_pyramid.clear();
+		else
+			_pyramid.build(box.x(), box.y(), box.r(), box.t(),
+				PYRAMID_BLOCK, (int)stats[2], (int)stats[3], &stats[4]);
+	}
+
+	/*! Runs the horizontal windows over row in for up to four channels at
+	 * once. radii holds each pixel's window radius from x onwards.
+	 */
+	template <class Op>
+	void hpass(const Row& in, Row& out, int x, int r, const std::vector<int>& radii,
+		int maxRadius, const Channel* chans, int n)
+	{
+		const int left = in.getLeft();
+		const int right = in.getRight();
+		const float* from[4];
+		float* to[4];
+		for (int c=0; c < 4; c++){
+			from[c] = in[chans[std::min(c, n - 1)]];
+			to[c] = out.writable(chans[std::min(c, n - 1)]);
+		}
+
+		MinMaxTable<Op> table;
+		__m128* entries = table.reset(right - left, 2 * maxRadius);
+		for (int X = left; X < right; X++)
+			entries[X - left] = _mm_setr_ps(from[0][X], from[1][X], from[2][X], from[3][X]);
+		table.build();
+
+		int X = x;
+		while (X < r){
+			// copy the run of pixels with nothing to dilate
+			const int run = X;
+			while (X < r && radii[X - x] <= 0)
+				X++;
+			for (int c=0; c < n; c++)
+				memcpy(to[c] + run, from[c] + run, (X - run) * sizeof(float));
 
+			for (; X < r && radii[X - x] > 0; X++){
+				const int k = radii[X - x];
+				const int np = std::max(X - k, left);
+				const int pp = std::min(X + k, right);
+				const __m128 v = Op::apply(table.at(X - left), table.query(np - left, pp - left));
+				float lanes[4];
+				_mm_storeu_ps(lanes, v);
+				for (int c=0; c < n; c++)
+					to[c][X] = lanes[c];
+			}
+		}
+	}
 
-				const float *cur = row[mchan] + fx;
-				const float *end = row[mchan] + fr;
-				while (cur < end){
-					_maxValue = std::max((float)fabs((float)*cur), _maxValue);
-					cur++;
+	/*! Runs the horizontal windows over channel z of row in as bits,
+	 * returning false if z isn't binary.
+	 */
+	template <class Op>
+	bool hpassBits(const Row& in, Row& out, int x, int r, const std::vector<int>& radii,
+		int maxRadius, Channel z)
+	{
+		const int left = in.getLeft();
+		const int right = in.getRight();
+		BitRowTable<Op> table;
+		if (!packBits(in[z] + left, right - left, table.reset(right - left, 2 * maxRadius), _binary == BINARY_ON))
+			return false;
+		table.build();
+
+		float* to = out.writable(z);
+		for (int X = x; X < r; X++){
+			const int k = radii[X - x];
+			bool v = table.at(X - left);
+			if (k > 0){
+				const int np = std::max(X - k, left);
+				const int pp = std::min(X + k, right);
+				v = Op::apply((uint64_t)v, (uint64_t)table.query(np - left, pp - left)) != 0;
+			}
+			to[X] = v ? 1.0f : 0.0f;
+		}
+		return true;
+	}
+
+	/*! State shared by the threads of buildBox(). Each stage is cut into
+	 * units that the threads claim until there are none left.
+	 */
+	struct PlaneJob
+	{
+		enum Stage { TRANSPOSE, VERTICAL, TRANSPOSE_BACK, HORIZONTAL };
+
+		DrivenDilate* op;
+		int stage;
+		int units;
+		volatile int next;
+		int x, y, width, height;
+		int count; // channels, not counting the mask plane after them
+		float* rows;
+		float* columns;
+		float* result;
+	};
+
+	static void planeThread(unsigned, unsigned, void* data)
+	{
+		PlaneJob& job = *(PlaneJob*)data;
+		for (;;){
+			const int unit = __sync_fetch_and_add(&job.next, 1);
+			if (unit >= job.units || job.op->aborted())
+				return;
+			if (job.op->v_do_min && job.stage == PlaneJob::VERTICAL)
+				job.op->planeUnit<MinOp>(job, unit);
+			else if (job.op->h_do_min && job.stage == PlaneJob::HORIZONTAL)
+				job.op->planeUnit<MinOp>(job, unit);
+			else
+				job.op->planeUnit<MaxOp>(job, unit);
+		}
+	}
+
+	bool runPlaneStage(PlaneJob& job, int stage, int units)
+	{
+		job.stage = stage;
+		job.units = units;
+		job.next = 0;
+		Thread::spawn(planeThread, std::max(1u, Thread::numThreads), &job);
+		Thread::wait(&job);
+		return !aborted();
+	}
+
+	/*! Does one unit of a buildBox() stage: a tile of one plane for the
+	 * transposes, or a strip of lines for the passes. Windows are worked
+	 * out exactly as the row engine does.
+	 */
+	template <class Op>
+	void planeUnit(PlaneJob& job, int unit)
+	{
+		const int width = job.width;
+		const int height = job.height;
+		const size_t size = (size_t)width * height;
+		const int tilesX = (width + PLANE_TILE - 1) / PLANE_TILE;
+		const int tilesY = (height + PLANE_TILE - 1) / PLANE_TILE;
+		MinMaxTable<Op> table;
+		const float* src[4];
+		float* dst[4];
+
+		switch (job.stage){
+		case PlaneJob::TRANSPOSE:
+		case PlaneJob::TRANSPOSE_BACK: {
+			const int p = unit / (tilesX * tilesY);
+			const int tx = unit % tilesX * PLANE_TILE;
+			const int ty = unit / tilesX % tilesY * PLANE_TILE;
+			if (job.stage == PlaneJob::TRANSPOSE)
+				transposeTile(job.rows + p * size, job.columns + p * size, width, height, tx, ty);
+			else
+				transposeTile(job.columns + p * size, job.rows + p * size, height, width, ty, tx);
+			break;
+		}
+		case PlaneJob::VERTICAL: {
+			std::vector<int> starts(height), ends(height);
+			const int X1 = std::min(width, (unit + 1) * PLANE_TILE);
+			for (int X = unit * PLANE_TILE; X < X1; X++){
+				const float* mask = job.columns + job.count * size + (size_t)X * height;
+				bool identity = true;
+				for (int j=0; j < height; j++){
+					const int Y = job.y + j;
+					float mval = mask[j];
+					const int start = std::max(job.y, (int)(Y - (v_size*mval)));
+					const int end = std::min(job.y + height, (int)(Y + (v_size*mval)));
+					if (start < end && (start != Y || end != Y + 1))
+						identity = false;
+					starts[j] = start - job.y;
+					ends[j] = end - job.y;
+				}
+				if (identity)
+					continue;
+				for (int g=0; g < job.count; g += 4){
+					const int n = std::min(4, job.count - g);
+					for (int c=0; c < 4; c++){
+						dst[c] = job.columns + (g + std::min(c, n - 1)) * size + (size_t)X * height;
+						src[c] = dst[c];
+					}
+					windowLine(src, dst, n, height, &starts[0], &ends[0], height, table);
+				}
+			}
+			break;
+		}
+		case PlaneJob::HORIZONTAL: {
+			std::vector<int> starts(width), ends(width);
+			const int Y1 = std::min(height, (unit + 1) * PLANE_TILE);
+			for (int Y = unit * PLANE_TILE; Y < Y1; Y++){
+				const float* mask = job.rows + job.count * size + (size_t)Y * width;
+				int maxRadius = 0;
+				for (int X=0; X < width; X++){
+					const int k = (int)(h_size * mask[X]);
+					starts[X] = k > 0 ? std::max(X - k, 0) : X;
+					ends[X] = k > 0 ? std::min(X + k, width) : X;
+					maxRadius = std::max(maxRadius, k);
+				}
+				for (int g=0; g < job.count; g += 4){
+					const int n = std::min(4, job.count - g);
+					for (int c=0; c < 4; c++){
+						src[c] = job.rows + (g + std::min(c, n - 1)) * size + (size_t)Y * width;
+						dst[c] = job.result + (g + std::min(c, n - 1)) * size + (size_t)Y * width;
+					}
+					if (maxRadius > 0)
+						windowLine(src, dst, n, width, &starts[0], &ends[0], 2 * maxRadius, table);
+					else
+						for (int c=0; c < n; c++)
+							memcpy(dst[c], src[c], width * sizeof(float));
+					// the row engine would have thresholded these too
+					if (_binary == BINARY_ON)
+						for (int c=0; c < n; c++)
+							for (int X=0; X < width; X++)
+								dst[c][X] = dst[c][X] > 0.5f ? 1.0f : 0.0f;
 				}
 			}
-			_firstTime = false;
+			break;
+		}
+		}
+	}
+
+	/*! Works out the box shape over the whole bbox. Both passes run along
+	 * contiguous lines: the planes are transposed, a tile at a time, for
+	 * the vertical pass and back again for the horizontal one.
+	 */
+	bool buildBox(ChannelSet channels, EnginePlane& plane)
+	{
+		const int x = info_.x();
+		const int y = info_.y();
+		const int width = info_.r() - x;
+		const int height = info_.t() - y;
+		const size_t size = (size_t)width * height;
+		in_channels(0, channels);
+		Tile tile(input0(), x, y, info_.r(), info_.t(), channels, true);
+		if (aborted())
+			return false;
+
+		Channel mchan(maskChan[0]);
+		const bool haveMask = intersect(tile.channels(), mchan);
+		plane.channels = channels;
+		plane.channels -= mchan;
+		const int count = plane.channels.size();
+		plane.pixels.resize(count * size);
+		if (!count || !size)
+			return true;
+
+		// the mask goes in a plane of its own after the others
+		std::vector<float> rows((count + 1) * size, 0.0f);
+		float* dst = &rows[0];
+		foreach (z, plane.channels){
+			for (int Y=0; Y < height; Y++)
+				memcpy(dst + (size_t)Y * width, &tile[z][y + Y][x], width * sizeof(float));
+			dst += size;
+		}
+		if (haveMask)
+			for (int Y=0; Y < height; Y++)
+				memcpy(dst + (size_t)Y * width, &tile[mchan][y + Y][x], width * sizeof(float));
+
+		PlaneJob job;
+		job.op = this;
+		job.x = x;
+		job.y = y;
+		job.width = width;
+		job.height = height;
+		job.count = count;
+		job.rows = &rows[0];
+		job.result = &plane.pixels[0];
+		job.columns = 0;
+
+		const int tiles = ((width + PLANE_TILE - 1) / PLANE_TILE) * ((height + PLANE_TILE - 1) / PLANE_TILE);
+		if (v_size){
+			std::vector<float> columns((count + 1) * size);
+			job.columns = &columns[0];
+			if (!runPlaneStage(job, PlaneJob::TRANSPOSE, (count + 1) * tiles) ||
+				!runPlaneStage(job, PlaneJob::VERTICAL, (width + PLANE_TILE - 1) / PLANE_TILE) ||
+				!runPlaneStage(job, PlaneJob::TRANSPOSE_BACK, count * tiles))
+				return false;
+		}
+		return runPlaneStage(job, PlaneJob::HORIZONTAL, (height + PLANE_TILE - 1) / PLANE_TILE);
+	}
+
+	/*! Threshold levels for the round shape: the channel's distinct values if
+	 * there are no more than _levels of them, otherwise _levels even steps
+	 * across its range, which can fall up to a step short of the exact
+	 * result. The level every pixel reaches is left out.
+	 */
+	void roundThresholds(const std::vector<float>& values, bool doMin, std::vector<float>& out) const
+	{
+		out.clear();
+		if (values.empty())
+			return;
+		const int levels = std::max(1, _levels);
+		std::set<float> distinct;
+		for (size_t i=0; i < values.size() && (int)distinct.size() <= levels; i++)
+			distinct.insert(values[i]);
+
+		if ((int)distinct.size() <= levels){
+			out.assign(distinct.begin(), distinct.end());
+		} else {
+			float lo = values[0];
+			float hi = values[0];
+			minMax(&values[0], values.size(), lo, hi);
+			for (int i=0; i <= levels; i++)
+				out.push_back(lo + (hi - lo) * i / levels);
+		}
+		if (doMin)
+			out.pop_back();
+		else
+			out.erase(out.begin());
+	}
+
+	/*! Works out the round shape over the whole bbox. Each threshold's level
+	 * set goes through a separable distance transform, so the cost depends
+	 * on the number of levels rather than the size. Every pixel compares
+	 * the distances against its own reach, so the radii are exact and only
+	 * the values are quantised.
+	 */
+	bool buildRound(ChannelSet channels, EnginePlane& plane)
+	{
+		const int x = info_.x();
+		const int y = info_.y();
+		const int width = info_.r() - x;
+		const int height = info_.t() - y;
+		const size_t size = (size_t)width * height;
+		in_channels(0, channels);
+		Tile tile(input0(), x, y, info_.r(), info_.t(), channels, true);
+		if (aborted())
+			return false;
+
+		// squared mask, in units of the size, each pixel's reach must be within
+		Channel mchan(maskChan[0]);
+		const bool haveMask = intersect(tile.channels(), mchan);
+		std::vector<float> reach(size);
+		for (int Y=0; Y < height; Y++){
+			for (int X=0; X < width; X++){
+				const float m = haveMask ? tile[mchan][y + Y][x + X] : 0.0f;
+				reach[Y * width + X] = m > 0.0f ? m * m : -1.0f;
+			}
+		}
+
+		plane.channels = channels;
+		plane.channels -= mchan;
+		plane.pixels.resize(plane.channels.size() * size);
+
+		RoundJob job;
+		job.width = width;
+		job.height = height;
+		job.reach = &reach[0];
+		job.doMin = h_do_min;
+		job.rowWeight = h_size ? 1.0 / ((double)h_size * h_size) : 0.0;
+		job.columnWeight = v_size ? 1.0 / ((double)v_size * v_size) : 0.0;
+		std::vector<float> values(size), feature(size), rowDist(size);
+		std::vector<float> thresholds;
+		const unsigned nThreads = std::max(1u, Thread::numThreads);
+
+		float* result = plane.pixels.empty() ? 0 : &plane.pixels[0];
+		foreach (z, plane.channels){
+			for (int Y=0; Y < height; Y++)
+				for (int X=0; X < width; X++)
+					values[Y * width + X] = tile[z][y + Y][x + X];
+			memcpy(result, &values[0], size * sizeof(float));
+
+			roundThresholds(values, h_do_min, thresholds);
+			for (size_t i=0; i < thresholds.size(); i++){
+				if (aborted())
+					return false;
+				const float t = thresholds[i];
+				for (size_t p=0; p < size; p++)
+					feature[p] = (h_do_min ? values[p] <= t : values[p] >= t) ? 0.0f : FAR_AWAY;
+				job.feature = &feature[0];
+				job.rowDist = &rowDist[0];
+				job.result = result;
+				job.threshold = t;
+				for (int pass=0; pass < 2; pass++){
+					job.columns = pass == 1;
+					Thread::spawn(roundThread, nThreads, &job);
+					Thread::wait(&job);
+				}
+			}
+			result += size;
+		}
+		return true;
+	}
+
+	// Builds the plane of channels for enginePlane().
+	bool buildPlane(const ChannelSet& channels, EnginePlane& plane)
+	{
+		return _shape == SHAPE_ROUND ? buildRound(channels, plane) : buildBox(channels, plane);
+	}
+
+	// Copies a row out of the plane built by buildRound() or buildBox().
+	void enginePlane(int y, int x, int r, ChannelMask channels, Row& out)
+	{
+		ChannelSet wanted(channels);
+		wanted -= Channel(maskChan[0]);
+		EnginePlane* plane = _plane.acquire(*this, _requested, wanted);
+		if (!plane)
+			return;
+
+		ChannelSet missing(channels);
+		const int width = info_.r() - info_.x();
+		const size_t size = (size_t)width * (info_.t() - info_.y());
+		const float* src = plane->pixels.empty() ? 0 : &plane->pixels[0];
+		foreach (z, plane->channels){
+			if (intersect(channels, z)){
+				const float* row = src + (y - info_.y()) * width - info_.x();
+				memcpy(out.writable(z) + x, row + x, (r - x) * sizeof(float));
+				missing -= z;
+			}
+			src += size;
+		}
+		_plane.release(plane);
+		// anything not in the plane, like the mask, passes through
+		if (!missing.empty()){
+			Row in(x, r);
+			in.get(input0(), y, x, r, missing);
+			foreach (z, missing)
+				memcpy(out.writable(z) + x, in[z] + x, (r - x) * sizeof(float));
 		}
 	}
 
@@ -217,12 +1141,20 @@ public:
 		if (aborted())
 			return;
 
-		if (h_size){
-			// determine max/min row size
-			float rm = x - (bboxAdjust + (h_size * _maxValue));
+		if (_shape == SHAPE_ROUND || _planar){
+			enginePlane(y, x, r, channels, out);
+			return;
+		}
+
+		// windows of less than a pixel leave the row as it is
+		const float rowMax = localMax(x, y, r, y + 1);
+		const int maxRadius = (int)(h_size * rowMax);
+		if (maxRadius > 0){
+			// determine max/min row size from the mask around this row
+			int rm = x - padding(h_size, rowMax);
 			if (rm < info_.x())
 				rm = info_.x();
-			float rx = r + (bboxAdjust + (h_size * _maxValue));
+			int rx = r + padding(h_size, rowMax);
 			if (rx > info_.r())
 				rx = info_.r();
 
@@ -235,34 +1167,60 @@ public:
 			if (!intersect(in.writable_channels(), mchan))
 				mchan = Chan_Black;
 
+			// find each pixel's window once for all channels, noting whether
+			// any of them does anything
 			const float* DRIVEN = in[mchan];
+			std::vector<int> radii(r - x);
+			bool identity = true;
+			for (int X=x; X < r; X++){
+				const int k = std::min((int)(h_size * DRIVEN[X]), maxRadius);
+				radii[X - x] = k;
+				if (k > 0)
+					identity = false;
+			}
+
+			// binary channels go through as bits, the others are processed
+			// in groups of four
+			std::vector<Channel> dilated;
 			foreach (z, cl){
 				if (z == maskChan[0])
 					continue;
-				float* TO = out.writable(z);
-				const float* FROM = in[z];
-				int X;
-				for (X=x; X < r; X++){
-					float mval = DRIVEN[X];
-					int np = (X - (int)(h_size * mval));
-					int pp = (X + (int)(h_size * mval));
-					float v = FROM[X];
-					for (int cx=np; cx < pp; cx++){
-						if (h_do_min){
-							v = MIN(v, FROM[cx]);
-						} else {
-							v = MAX(v, FROM[cx]);
-						}
-					}
-					TO[X] = v;
+				if (!identity && _binary != BINARY_OFF){
+					if (h_do_min ? hpassBits<MinOp>(in, out, x, r, radii, maxRadius, z)
+						: hpassBits<MaxOp>(in, out, x, r, radii, maxRadius, z))
+						continue;
+				}
+				dilated.push_back(z);
+			}
+			for (size_t g=0; g < dilated.size(); g += 4){
+				const int n = std::min(4, (int)(dilated.size() - g));
+				if (identity){
+					for (int c=0; c < n; c++)
+						memcpy(out.writable(dilated[g + c]) + x, in[dilated[g + c]] + x, (r - x) * sizeof(float));
+					continue;
 				}
+				if (h_do_min)
+					hpass<MinOp>(in, out, x, r, radii, maxRadius, &dilated[g], n);
+				else
+					hpass<MaxOp>(in, out, x, r, radii, maxRadius, &dilated[g], n);
 			}
 		} else {
 			get_vpass(y, x, r, cl, out);
 			if (aborted())
 				return;
 		}
-}
+
+		// the untouched pixels have to match the packed ones
+		if (_binary == BINARY_ON){
+			foreach (z, channels){
+				if (z == maskChan[0])
+					continue;
+				float* to = out.writable(z);
+				for (int X = x; X < r; X++)
+					to[X] = to[X] > 0.5f ? 1.0f : 0.0f;
+			}
+		}
+	}
 
 };
 
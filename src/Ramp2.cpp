@@ -26,7 +26,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 
 static const char* const CLASS="Ramp2";
-static const char* const HELP="A basic gradient ramp with two points and two color values";
+static const char* const HELP="A gradient ramp between two points, linear, radial or angular, with color stops between its two color values";
 
 #include "DDImage/ColorLookup.h"
 #include "DDImage/DDWindows.h"
@@ -41,12 +41,149 @@ static const char* const HELP="A basic gradient ramp with two points and two col
 #include "DDImage/DDMath.h"
 #include "DDImage/Transform.h"
 #include "DDImage/LookupCurves.h"
+#include "DDImage/Thread.h"
 #include <math.h>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 #include "DDImage/Vector2.h"
+#include "RampKernels.h"
 
 using namespace DD::Image;
 using namespace std;
 
+// entries the gradient is baked into per channel, from p0 to p1
+static const int TABLE_SIZE = 4096;
+
+static const char* const MODES[] = { "linear", "radial", "angular", 0 };
+enum { MODE_LINEAR, MODE_RADIAL, MODE_ANGULAR };
+
+// color stops between color 0 and color 1
+static const int MAX_STOPS = 6;
+static const char* const STOP_NAMES[] = { "stop1", "stop2", "stop3", "stop4", "stop5", "stop6" };
+static const char* const STOP_LABELS[] = { "stop 1", "stop 2", "stop 3", "stop 4", "stop 5", "stop 6" };
+static const char* const STOP_COLORS[] = { "stop1_col", "stop2_col", "stop3_col", "stop4_col", "stop5_col", "stop6_col" };
+
+// megabytes of rendered ramps kept for other frames and views, unless
+// NKTOOLS_RAMP_CACHE says otherwise, 0 turning the cache off
+static const size_t RAMP_CACHE_MB = 512;
+
+enum { ROW_EMPTY, ROW_FILLING, ROW_DONE };
+
+/*! A rendered ramp, shared by every Ramp2 op with the same knobs and bbox
+ * whatever frame or view it renders, with a plane for each channel that
+ * isn't black. Rows are filled the first time any op asks for them.
+ */
+struct RampPlane
+{
+    uint64_t key;
+    int refs;
+    Box box;
+    size_t bytes;
+    float* pixels[4];
+    std::vector<int> rows;
+
+    RampPlane(uint64_t k, const Box& b) : key(k), refs(0), box(b), bytes(0), rows(b.h(), ROW_EMPTY)
+    {
+        pixels[0] = pixels[1] = pixels[2] = pixels[3] = 0;
+    }
+    ~RampPlane()
+    {
+        for (int z=0; z<4; z++)
+            free(pixels[z]);
+    }
+
+    float* row(int z, int y)
+    {
+        return pixels[z] + (size_t)(y - box.y()) * box.w() - box.x();
+    }
+};
+
+// keys seen lately, so a ramp is only cached once it comes back
+static const size_t RAMP_SEEN = 16;
+
+static Lock rampLock;
+// least recently used first
+static std::vector<RampPlane*> rampPlanes;
+static size_t rampBytes = 0;
+static std::vector<uint64_t> rampSeen;
+
+static size_t rampBudget()
+{
+    static const char* env = getenv("NKTOOLS_RAMP_CACHE");
+    return (env && *env ? (size_t)atol(env) : RAMP_CACHE_MB) << 20;
+}
+
+/*! Finds or makes the plane for key, with the channels in used, and holds
+ * it until releasePlane(). A plane is only made the second time a key is
+ * asked for, so an animated ramp never pays to fill planes nothing reuses.
+ * Unheld planes are dropped oldest first to make room, and no plane is made
+ * if the held ones leave no room for it.
+ */
+static RampPlane* acquirePlane(uint64_t key, const Box& box, const bool* used)
+{
+    Guard guard(rampLock);
+    for (size_t i=0; i<rampPlanes.size(); i++){
+        if (rampPlanes[i]->key == key){
+            RampPlane* plane = rampPlanes[i];
+            rampPlanes.erase(rampPlanes.begin() + i);
+            rampPlanes.push_back(plane);
+            plane->refs++;
+            return plane;
+        }
+    }
+
+    std::vector<uint64_t>::iterator seen = std::find(rampSeen.begin(), rampSeen.end(), key);
+    if (seen == rampSeen.end()){
+        if (rampSeen.size() == RAMP_SEEN)
+            rampSeen.erase(rampSeen.begin());
+        rampSeen.push_back(key);
+        return 0;
+    }
+    rampSeen.erase(seen);
+
+    size_t bytes = 0;
+    for (int z=0; z<4; z++)
+        bytes += used[z] ? (size_t)box.w() * box.h() * sizeof(float) : 0;
+    const size_t budget = rampBudget();
+    if (!bytes || bytes > budget)
+        return 0;
+    for (size_t i=0; i<rampPlanes.size() && rampBytes + bytes > budget; ){
+        if (rampPlanes[i]->refs == 0){
+            rampBytes -= rampPlanes[i]->bytes;
+            delete rampPlanes[i];
+            rampPlanes.erase(rampPlanes.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    if (rampBytes + bytes > budget)
+        return 0;
+
+    RampPlane* plane = new RampPlane(key, box);
+    for (int z=0; z<4; z++){
+        if (used[z] && !(plane->pixels[z] = (float*)malloc((size_t)box.w() * box.h() * sizeof(float)))){
+            delete plane;
+            return 0;
+        }
+    }
+    plane->bytes = bytes;
+    plane->refs = 1;
+    rampBytes += bytes;
+    rampPlanes.push_back(plane);
+    return plane;
+}
+
+static void releasePlane(RampPlane* plane)
+{
+    if (!plane)
+        return;
+    Guard guard(rampLock);
+    plane->refs--;
+}
+
 static const CurveDescription defaults[] = {
   { "master", "y C 0 1" },
   { "red",    "y C 0 1" },
@@ -71,6 +208,19 @@ class Ramp2 : public Iop
     FormatPair formats;
     float ca;
     float sa;
+    int mode;
+    int stops;
+    float stopPos[MAX_STOPS];
+    float stopCol[MAX_STOPS][4];
+    // each channel's value against the position along the ramp, with the
+    // stops and lut applied, rebuilt when its hash changes
+    bool useTable;
+    std::vector<float> table[4];
+    Hash tableHash;
+    // the table modes' output for the other frames and views, held between
+    // _open and _close
+    uint64_t planeKey;
+    RampPlane* plane;
 
 public:
     const char* Class() const { return CLASS; }
@@ -95,12 +245,23 @@ public:
         channel[2] = Chan_Blue;
         channel[3] = Chan_Alpha;
         formats.format(0);
+        mode = MODE_LINEAR;
+        stops = 0;
+        useTable = false;
+        planeKey = 0;
+        plane = 0;
+        for (int i=0; i<MAX_STOPS; i++){
+            stopPos[i] = (i + 1) / float(MAX_STOPS + 1);
+            stopCol[i][0] = stopCol[i][1] = stopCol[i][2] = stopCol[i][3] = 0.5f;
+        }
 
         Vector2 rV = Vector2(0.0, 0.0); //
         Vector2 vP0 = Vector2(0.0, 0.0);
         Vector2 vP1 = Vector2(0.0, 0.0);
     };
 
+    ~Ramp2() { releasePlane(plane); }
+
     void _validate(bool for_real)
     {
         bool non_zero = false;
@@ -125,40 +286,202 @@ public:
             vP0 = Vector2(p0.x, p0.y); 
             vP1 = Vector2(p1.x, p1.y);
             rV = Vector2((p1.x - p0.x), (p1.y - p0.y));
+            // a plain linear ramp is filled directly, everything else
+            // looks its position up in the table
+            stops = clamp(stops, 0, MAX_STOPS);
+            useTable = enableLut == true || stops > 0 || mode != MODE_LINEAR;
+            if (useTable)
+                bakeTable();
+
+            // a plain linear ramp costs no more to fill than to copy, the
+            // others are cached on what they depend on, not the frame or view
+            planeKey = 0;
+            if (useTable){
+                Hash key;
+                key.append(mode);
+                key.append(p0.x);
+                key.append(p0.y);
+                key.append(p1.x);
+                key.append(p1.y);
+                key.append(tableHash);
+                key.append(info_.x());
+                key.append(info_.y());
+                key.append(info_.r());
+                key.append(info_.t());
+                planeKey = key.value();
+            }
         }
     }
 
-    void engine(int y, int xx, int r, ChannelMask channels, Row& row)
+    void _open()
     {
-        for (int x=xx; x<r; x++)
-        {
-            for (int z=0; z<4; z++){
-                if (low_col[z] || hi_col[z]){
-                    float* out = row.writable(channel[z]);
-                    Vector2 vC = Vector2(x, y); // current pixel
-                    // dot products
-                    float c1 = rV.x * p0.x + rV.y * p0.y;
-                    float c2 = rV.x * p1.x + rV.y * p1.y;
-                    float c = rV.x * x + rV.y * y;
-                    float pixcol = (low_col[z] * (c2 - c) + hi_col[z] * (c - c1))/(c2 - c1);
-
-                    out[x] = clamp(pixcol, min(low_col[z], hi_col[z]), max(low_col[z], hi_col[z]));
-                    if (enableLut == true){
-                        if (low_col[z] > hi_col[z]){
-                            // invert colors, run lut, then revert
-                            float o = (out[x]*-1)+1;
-                            o = lookup(z, o);
-                            out[x] = (o*-1)+1;
-                        } else {
-                            out[x] = lookup(z, out[x]);
-                        }
+        if (plane && plane->key == planeKey)
+            return;
+        releasePlane(plane);
+        plane = 0;
+        if (planeKey){
+            bool used[4];
+            for (int z=0; z<4; z++)
+                used[z] = active(z);
+            plane = acquirePlane(planeKey, info_, used);
+        }
+    }
+
+    void _close()
+    {
+        releasePlane(plane);
+        plane = 0;
+    }
+
+    // Whether channel z is anything but black anywhere along the ramp.
+    bool active(int z) const
+    {
+        if (low_col[z] || hi_col[z])
+            return true;
+        for (int i=0; i<stops; i++){
+            if (stopCol[i][z])
+                return true;
+        }
+        return false;
+    }
+
+    /*! Bakes each channel's gradient through the stops into a table from
+     * p0 to p1, composing the master and channel curves into it, with the
+     * inversion for a ramp going down. Only redone when the stops, colors
+     * or curves change.
+     */
+    void bakeTable()
+    {
+        Hash hash;
+        if (enableLut == true)
+            lut.append(hash);
+        hash.append(enableLut);
+        hash.append(stops);
+        for (int z=0; z<4; z++){
+            hash.append(low_col[z]);
+            hash.append(hi_col[z]);
+            for (int i=0; i<stops; i++)
+                hash.append(stopCol[i][z]);
+        }
+        for (int i=0; i<stops; i++)
+            hash.append(stopPos[i]);
+        if (hash == tableHash && !table[0].empty())
+            return;
+        tableHash = hash;
+
+        // the stops in order of position, with the end colors at 0 and 1
+        std::vector<float> pos(1, 0.0f);
+        std::vector<const float*> col(1, low_col);
+        for (int i=0; i<stops; i++){
+            const float p = clamp(stopPos[i], 0.0f, 1.0f);
+            size_t j = pos.size();
+            while (j > 1 && pos[j - 1] > p)
+                j--;
+            pos.insert(pos.begin() + j, p);
+            col.insert(col.begin() + j, stopCol[i]);
+        }
+        pos.push_back(1.0f);
+        col.push_back(hi_col);
+
+        for (int z=0; z<4; z++){
+            table[z].resize(TABLE_SIZE + 1);
+            size_t j = 0;
+            for (int i=0; i<=TABLE_SIZE; i++){
+                const float t = i / float(TABLE_SIZE);
+                while (j + 2 < pos.size() && pos[j + 1] <= t)
+                    j++;
+                const float span = pos[j + 1] - pos[j];
+                const float w = span > 0 ? clamp((t - pos[j]) / span, 0.0f, 1.0f) : 1.0f;
+                float v = col[j][z] + (col[j + 1][z] - col[j][z]) * w;
+                if (enableLut == true){
+                    if (low_col[z] > hi_col[z]){
+                        // invert colors, run lut, then revert
+                        v = 1 - lookup(z, 1 - v);
+                    } else {
+                        v = lookup(z, v);
                     }
                 }
-                continue;
+                table[z][i] = v;
             }
         }
+    }
+
+    void engine(int y, int x, int r, ChannelMask channels, Row& row)
+    {
+        float* out[4];
+        for (int z=0; z<4; z++)
+            out[z] = active(z) ? row.writable(channel[z]) : 0;
+        if (!cachedRow(y, x, r, out))
+            renderRow(y, x, r, out);
     };
 
+    /*! Copies row y from the shared plane, filling it first if no op has.
+     * Returns false if there is no plane, the row is outside it or another
+     * thread is filling it.
+     */
+    bool cachedRow(int y, int x, int r, float* const* out)
+    {
+        if (!plane || y < plane->box.y() || y >= plane->box.t() ||
+            x < plane->box.x() || r > plane->box.r())
+            return false;
+        volatile int* state = &plane->rows[y - plane->box.y()];
+        if (*state != ROW_DONE){
+            if (!__sync_bool_compare_and_swap(state, ROW_EMPTY, ROW_FILLING))
+                return false;
+            float* to[4];
+            for (int z=0; z<4; z++)
+                to[z] = out[z] ? plane->row(z, y) : 0;
+            renderRow(y, plane->box.x(), plane->box.r(), to);
+            __sync_synchronize();
+            *state = ROW_DONE;
+        }
+        __sync_synchronize();
+        for (int z=0; z<4; z++){
+            if (out[z])
+                memcpy(out[z] + x, plane->row(z, y) + x, (r - x) * sizeof(float));
+        }
+        return true;
+    }
+
+    // Renders row y from x to r into the channels of out that aren't null.
+    void renderRow(int y, int x, int r, float* const* out)
+    {
+        // the ramp is affine in x: t runs from 0 at p0 to 1 at p1, starting
+        // the row at t0 and stepping by dt per pixel
+        const float c1 = rV.x * p0.x + rV.y * p0.y;
+        const float c2 = rV.x * p1.x + rV.y * p1.y;
+        // with p1 on p0 the ramp has no length and sits at 0, as radial does
+        const float scale = c2 != c1 ? 1.0f / (c2 - c1) : 0.0f;
+        const float t0 = (rV.x * x + rV.y * y - c1) * scale;
+        const float dt = rV.x * scale;
+
+        if (!useTable){
+            for (int z=0; z<4; z++){
+                if (!out[z])
+                    continue;
+                const float range = hi_col[z] - low_col[z];
+                fillRamp(out[z] + x, r - x, low_col[z] + range * t0, range * dt,
+                         min(low_col[z], hi_col[z]), max(low_col[z], hi_col[z]));
+            }
+            return;
+        }
+
+        // where each pixel is along the ramp, then one lookup per channel
+        std::vector<float> t(r - x);
+        if (mode == MODE_LINEAR){
+            fillRamp(&t[0], r - x, t0, dt, 0.0f, 1.0f);
+        } else if (mode == MODE_RADIAL){
+            const float length = sqrt(rV.x * rV.x + rV.y * rV.y);
+            fillRadial(&t[0], r - x, x - p0.x, y - p0.y, length > 0 ? 1.0f / length : 0.0f);
+        } else {
+            fillAngular(&t[0], r - x, x - p0.x, y - p0.y, atan2(double(rV.y), double(rV.x)));
+        }
+        for (int z=0; z<4; z++){
+            if (out[z] && !table[z].empty())
+                lookupTable(&t[0], r - x, &table[z][0], TABLE_SIZE, out[z] + x);
+        }
+    }
+
     float lookup(int z, float value){
         value = float(lut.getValue(0, value));
         value = float(lut.getValue(z + 1, value));
@@ -179,6 +502,17 @@ public:
         Tooltip(f, "Position of p0");
         XY_knob(f, &p1[0], "p1");
         Tooltip(f, "Position of p1");
+        Enumeration_knob(f, &mode, MODES, "mode");
+        Tooltip(f, "linear ramps along the line from p0 to p1. radial ramps out from p0, reaching color 1 at the distance of p1. angular ramps once around p0, starting from the direction of p1.");
+        Int_knob(f, &stops, "stops");
+        SetRange(f, 0, MAX_STOPS);
+        Tooltip(f, "Number of color stops between color 0 and color 1");
+        for (int i=0; i<MAX_STOPS; i++){
+            Float_knob(f, &stopPos[i], STOP_NAMES[i], STOP_LABELS[i]);
+            Tooltip(f, "Position of the stop, from 0 at p0 to 1 at p1");
+            AColor_knob(f, stopCol[i], STOP_COLORS[i], "color");
+            Tooltip(f, "Color of the stop");
+        }
         Newline(f);
         Tab_knob(f, "Lut");
         BeginClosedGroup(f, "lutGroup", "lut");
@@ -0,0 +1,69 @@
+/* RampKernels.h
+Row kernels behind Ramp2, on plain float buffers
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_RAMPKERNELS_H
+#define NKTOOLS_RAMPKERNELS_H
+
+#include <math.h>
+#include <algorithm>
+#include "Dispatch.h"
+
+/*! Fills n floats of out with start + i * step, clamped to [lo, hi],
+ * as wide as the cpu goes.
+ */
+inline void fillRamp(float* out, int n, float start, float step, float lo, float hi)
+{
+    kernels().fillRamp(out, n, start, step, lo, hi);
+}
+
+/*! Fills n floats of out with the length of (dx + i, dy) times scale,
+ * clamped to 1, as wide as the cpu goes.
+ */
+inline void fillRadial(float* out, int n, float dx, float dy, float scale)
+{
+    kernels().fillRadial(out, n, dx, dy, scale);
+}
+
+/*! Fills n floats of out with the angle of (dx + i, dy) from the angle
+ * start, as a fraction of a turn.
+ */
+inline void fillAngular(float* out, int n, float dx, float dy, double start)
+{
+    for (int i=0; i<n; i++){
+        double a = (atan2(double(dy), double(dx + i)) - start) / (2 * M_PI);
+        a -= floor(a);
+        out[i] = std::min(float(a), 1.0f);
+    }
+}
+
+/*! Looks n positions from 0 to 1 up in a table of size + 1 entries,
+ * interpolating linearly. Positions outside are clamped, NaN to 1.
+ */
+inline void lookupTable(const float* t, int n, const float* table, int size, float* out)
+{
+    kernels().lookupTable(t, n, table, size, out);
+}
+
+#endif
@@ -0,0 +1,319 @@
+/* WarpKernels.h
+Splat, gather and hole fill kernels behind DisparityDistort, on plain
+float buffers
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_WARPKERNELS_H
+#define NKTOOLS_WARPKERNELS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// views the disparity is pushed along, both meaning left then right
+enum { VIEW_LEFT, VIEW_RIGHT, VIEW_BOTH };
+
+// rows a thread claims at a time in the planar passes
+static const int SPLAT_ROWS = 16;
+
+/*! Maps a float to an unsigned int that sorts the same way, so depths can
+ * be compared as integers.
+ */
+inline uint32_t orderedFloat(float f)
+{
+	union { float f; uint32_t u; } v;
+	v.f = f;
+	return (v.u & 0x80000000u) ? ~v.u : (v.u | 0x80000000u);
+}
+
+/*! State shared by the threads of the planar passes. The splat pass packs
+ * each landing pixel's depth above its source index and keeps the largest
+ * per output pixel with a compare and swap, so no locks are needed. The
+ * gather pass then copies each winner's values. Both views are pushed
+ * together from the same tile, the left one first.
+ */
+struct SplatJob
+{
+	volatile int nextRow;
+	int views;
+	// input tile
+	int sx, sy, sr, st;
+	const float* dispX[2];
+	const float* dispY[2];
+	// output planes
+	int x, y, r, t;
+	volatile uint64_t* winners[2];
+	int count;
+	std::vector<const float*> from;
+	std::vector<float*> to[2];
+};
+
+/*! Splat pass of the planar modes. The nearer of two pixels is the one
+ * pushed further left for the left view and further right for the right
+ * view. Without HAS_Y pixels stay on their row.
+ */
+template <bool HAS_Y, int VIEW>
+static void splatThread(unsigned, unsigned, void* data)
+{
+	SplatJob& job = *(SplatJob*)data;
+	const int sw = job.sr - job.sx;
+	const int width = job.r - job.x;
+	const int rows = job.st - job.sy;
+	const int views = VIEW == VIEW_BOTH ? 2 : 1;
+	for (;;){
+		const int first = __sync_fetch_and_add(&job.nextRow, SPLAT_ROWS);
+		if (first >= rows)
+			return;
+		const int last = std::min(rows, first + SPLAT_ROWS);
+		for (int j = first; j < last; j++){
+			const int U0 = job.sy + j;
+			if (!HAS_Y && (U0 < job.y || U0 >= job.t))
+				continue;
+			for (int v=0; v < views; v++){
+				const bool left = VIEW == VIEW_BOTH ? v == 0 : VIEW == VIEW_LEFT;
+				const float* dispX = job.dispX[v] + (size_t)j * sw;
+				const float* dispY = HAS_Y ? job.dispY[v] + (size_t)j * sw : 0;
+				for (int i=0; i < sw; i++){
+					const size_t index = (size_t)j * sw + i;
+					const float d = dispX[i];
+					const int T = job.sx + i + (int)floor(d + 0.5f);
+					const int U = HAS_Y ? U0 + (int)floor(dispY[i] + 0.5f) : U0;
+					if (T < job.x || T >= job.r || (HAS_Y && (U < job.y || U >= job.t)))
+						continue;
+					const float depth = left ? -d : d;
+					const uint64_t key = ((uint64_t)orderedFloat(depth) << 32) | (uint32_t)~index;
+					volatile uint64_t* winner = job.winners[v] + (size_t)(U - job.y) * width + T - job.x;
+					uint64_t old = *winner;
+					while (key > old){
+						const uint64_t seen = __sync_val_compare_and_swap(winner, old, key);
+						if (seen == old)
+							break;
+						old = seen;
+					}
+				}
+			}
+		}
+	}
+}
+
+// Gather pass of the planar modes.
+inline void gatherThread(unsigned, unsigned, void* data)
+{
+	SplatJob& job = *(SplatJob*)data;
+	const int width = job.r - job.x;
+	const int rows = job.t - job.y;
+	for (;;){
+		const int first = __sync_fetch_and_add(&job.nextRow, SPLAT_ROWS);
+		if (first >= rows)
+			return;
+		const int last = std::min(rows, first + SPLAT_ROWS);
+		for (int v=0; v < job.views; v++){
+			for (size_t p = (size_t)first * width; p < (size_t)last * width; p++){
+				const uint64_t winner = job.winners[v][p];
+				if (!winner)
+					continue;
+				// the lower bits hold the complement, so earlier pixels win ties
+				const uint32_t index = ~(uint32_t)winner;
+				for (int c=0; c < job.count; c++)
+					job.to[v][c][p] = job.from[c][index];
+			}
+		}
+	}
+}
+
+/*! Finds the input column landing on each output pixel in [x, r), from the
+ * disparity of input columns [sx, sr). source holds its offset from sx, as
+ * columns can be negative, or -1 where none lands.
+ */
+template <int VIEW>
+inline void forwardRow(const float* disp, int sx, int sr, int x, int r, int* source, float* nearest)
+{
+	for (int X = sx; X < sr; X++){
+		const float d = disp[X];
+		const int T = X + (int)floor(d + 0.5f);
+		if (T < x || T >= r)
+			continue;
+		const float depth = VIEW == VIEW_LEFT ? -d : d;
+		if (source[T - x] < 0 || depth > nearest[T - x]){
+			nearest[T - x] = depth;
+			source[T - x] = X - sx;
+		}
+	}
+}
+
+/*! Samples a plane for output row y at the positions the inverse
+ * disparity points to, skipping the holes. rows[Y - ty] is row Y of the
+ * plane, indexed by x, over [tx, tr) x [ty, tt). Without HAS_Y only row y
+ * is sampled.
+ */
+template <bool HAS_Y, bool BILINEAR>
+inline void gatherRow(const float* const* rows, int tx, int ty, int tr, int tt,
+	const float* invX, const float* invY, int y, int x, int r, float* to)
+{
+	tr--;
+	tt--;
+	for (int X = x; X < r; X++){
+		if (invX[X] != invX[X])
+			continue;
+		const float fx = std::min(std::max(X - invX[X], (float)tx), (float)tr);
+		const float fy = std::min(std::max(HAS_Y ? y - invY[X] : (float)y, (float)ty), (float)tt);
+		if (!BILINEAR){
+			to[X] = rows[(int)floor(fy + 0.5f) - ty][(int)floor(fx + 0.5f)];
+			continue;
+		}
+		const int x0 = (int)floor(fx);
+		const int y0 = (int)floor(fy);
+		const int x1 = std::min(x0 + 1, tr);
+		const float wx = fx - x0;
+		const float* row0 = rows[y0 - ty];
+		const float top = row0[x0] + (row0[x1] - row0[x0]) * wx;
+		if (!HAS_Y){
+			to[X] = top;
+			continue;
+		}
+		const float* row1 = rows[std::min(y0 + 1, tt) - ty];
+		const float wy = fy - y0;
+		const float bottom = row1[x0] + (row1[x1] - row1[x0]) * wx;
+		to[X] = top + (bottom - top) * wy;
+	}
+}
+
+/*! Fills the holes of count planes of width x height, the pixels whose
+ * coverage is 0, by push-pull: the covered values are averaged down an
+ * image pyramid, then each level's holes are filled from the level above,
+ * upsampled bilinearly. The pyramid has 4/3 the pixels of the image, so the
+ * time is linear in its size however big the holes are. Covered pixels
+ * keep their values.
+ */
+inline void pushPull(float* const* planes, int count, const float* coverage, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	// level k holds each pixel's weight, then count planes of premultiplied
+	// values
+	std::vector<int> widths(1, width), heights(1, height);
+	std::vector<std::vector<float> > levels(1);
+	const size_t size = (size_t)width * height;
+	levels[0].resize((count + 1) * size);
+	memcpy(&levels[0][0], coverage, size * sizeof(float));
+	for (int c=0; c < count; c++){
+		float* v = &levels[0][(c + 1) * size];
+		for (size_t p=0; p < size; p++)
+			v[p] = coverage[p] ? planes[c][p] : 0.0f;
+	}
+
+	// push: sum each 2x2 block, keeping the weight at most 1
+	while (widths.back() > 1 || heights.back() > 1){
+		const int w = widths.back();
+		const int h = heights.back();
+		const int cw = (w + 1) / 2;
+		const int ch = (h + 1) / 2;
+		const size_t fineSize = (size_t)w * h;
+		const size_t coarseSize = (size_t)cw * ch;
+		levels.push_back(std::vector<float>((count + 1) * coarseSize, 0.0f));
+		const std::vector<float>& fine = levels[levels.size() - 2];
+		std::vector<float>& coarse = levels.back();
+		for (int y=0; y < ch; y++){
+			for (int x=0; x < cw; x++){
+				const size_t q = (size_t)y * cw + x;
+				const int y1 = std::min(2 * y + 1, h - 1);
+				const int x1 = std::min(2 * x + 1, w - 1);
+				float weight = 0.0f;
+				for (int Y = 2 * y; Y <= y1; Y++)
+					for (int X = 2 * x; X <= x1; X++)
+						weight += fine[(size_t)Y * w + X];
+				if (weight <= 0.0f)
+					continue;
+				const float scale = weight > 1.0f ? 1.0f / weight : 1.0f;
+				coarse[q] = weight * scale;
+				for (int c=0; c < count; c++){
+					const float* v = &fine[(c + 1) * fineSize];
+					float sum = 0.0f;
+					for (int Y = 2 * y; Y <= y1; Y++)
+						for (int X = 2 * x; X <= x1; X++)
+							sum += v[(size_t)Y * w + X];
+					coarse[(c + 1) * coarseSize + q] = sum * scale;
+				}
+			}
+		}
+		widths.push_back(cw);
+		heights.push_back(ch);
+	}
+
+	// the top is a single pixel, unpremultiplied it is the fill of the
+	// levels below
+	std::vector<float>& top = levels.back();
+	for (int c=0; c < count; c++)
+		top[c + 1] = top[0] > 0.0f ? top[c + 1] / top[0] : 0.0f;
+	top[0] = 1.0f;
+
+	// pull: blend each level with the filled level above by its weight
+	for (int k = (int)levels.size() - 2; k >= 0; k--){
+		const int w = widths[k];
+		const int h = heights[k];
+		const int cw = widths[k + 1];
+		const int ch = heights[k + 1];
+		const size_t fineSize = (size_t)w * h;
+		const size_t coarseSize = (size_t)cw * ch;
+		std::vector<float>& fine = levels[k];
+		const std::vector<float>& coarse = levels[k + 1];
+		for (int y=0; y < h; y++){
+			// the two coarse rows around this one, weighted 3/4 and 1/4
+			const int y0 = y / 2;
+			const int y1 = std::min(std::max((y & 1) ? y0 + 1 : y0 - 1, 0), ch - 1);
+			for (int x=0; x < w; x++){
+				const size_t p = (size_t)y * w + x;
+				const float weight = fine[p];
+				if (weight >= 1.0f){
+					for (int c=0; c < count; c++)
+						fine[(c + 1) * fineSize + p] /= weight;
+					continue;
+				}
+				const int x0 = x / 2;
+				const int x1 = std::min(std::max((x & 1) ? x0 + 1 : x0 - 1, 0), cw - 1);
+				for (int c=0; c < count; c++){
+					const float* v = &coarse[(c + 1) * coarseSize];
+					const float up = 0.5625f * v[(size_t)y0 * cw + x0] + 0.1875f * v[(size_t)y0 * cw + x1] +
+						0.1875f * v[(size_t)y1 * cw + x0] + 0.0625f * v[(size_t)y1 * cw + x1];
+					float& value = fine[(c + 1) * fineSize + p];
+					value += (1.0f - weight) * up;
+				}
+			}
+		}
+		levels[k + 1].clear();
+	}
+
+	for (int c=0; c < count; c++){
+		const float* v = &levels[0][(c + 1) * size];
+		for (size_t p=0; p < size; p++){
+			if (!coverage[p])
+				planes[c][p] = v[p];
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,757 @@
+/* DDImage.cpp
+Implementation of the DDImage stand-in the plugins build against when no
+Nuke install is around
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDImage/ChannelSet.h"
+#include "DDImage/Format.h"
+#include "DDImage/Iop.h"
+#include "DDImage/Knob.h"
+#include "DDImage/LookupCurves.h"
+#include "DDImage/NukeWrapper.h"
+#include "DDImage/Row.h"
+#include "DDImage/Thread.h"
+#include "DDImage/Tile.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+
+namespace DD {
+namespace Image {
+
+const char* getName(Channel z)
+{
+	static const char* const NAMES[Chan_Last] = {
+		"black", "rgba.red", "rgba.green", "rgba.blue", "rgba.alpha", "depth.Z",
+		"forward.u", "forward.v", "backward.u", "backward.v",
+		"disparityL.x", "disparityL.y", "disparityR.x", "disparityR.y", "mask.a"
+	};
+	return z >= Chan_Black && z < Chan_Last ? NAMES[z] : "unknown";
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// threads
+
+static unsigned cpuCount()
+{
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? unsigned(n) : 1u;
+}
+
+static unsigned threadCount()
+{
+	const char* env = getenv("NKTOOLS_THREADS");
+	const int n = env ? atoi(env) : 0;
+	return n > 0 ? unsigned(n) : cpuCount();
+}
+
+namespace Thread {
+
+unsigned numCPUs = cpuCount();
+unsigned numThreads = threadCount();
+
+struct Worker {
+	ThreadFunction* f;
+	unsigned index;
+	unsigned count;
+	void* data;
+	pthread_t thread;
+};
+
+typedef std::multimap<void*, Worker*> Workers;
+
+static Lock& workersLock()
+{
+	static Lock lock;
+	return lock;
+}
+
+static Workers& workers()
+{
+	static Workers running;
+	return running;
+}
+
+static void* run(void* p)
+{
+	Worker* w = static_cast<Worker*>(p);
+	w->f(w->index, w->count, w->data);
+	return 0;
+}
+
+void spawn(ThreadFunction* f, int n, void* data)
+{
+	const unsigned count = unsigned(std::max(n, 1));
+	for (unsigned i=0; i < count; i++){
+		Worker* w = new Worker;
+		w->f = f;
+		w->index = i;
+		w->count = count;
+		w->data = data;
+		if (pthread_create(&w->thread, 0, run, w) != 0){
+			// out of threads, do the slice here instead
+			run(w);
+			delete w;
+			continue;
+		}
+		Guard guard(workersLock());
+		workers().insert(std::make_pair(data, w));
+	}
+}
+
+void wait(void* data)
+{
+	std::vector<Worker*> joining;
+	{
+		Guard guard(workersLock());
+		std::pair<Workers::iterator, Workers::iterator> range = workers().equal_range(data);
+		for (Workers::iterator it = range.first; it != range.second; ++it)
+			joining.push_back(it->second);
+		workers().erase(range.first, range.second);
+	}
+	for (size_t i=0; i < joining.size(); i++){
+		pthread_join(joining[i]->thread, 0);
+		delete joining[i];
+	}
+}
+
+}
+
+void sleepFor(double seconds)
+{
+	timespec ts;
+	ts.tv_sec = time_t(seconds);
+	ts.tv_nsec = long((seconds - double(ts.tv_sec)) * 1e9);
+	nanosleep(&ts, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// knobs
+
+Knob::Knob(const char* name, const char* label, Type type, void* storage, int count)
+	: _name(name), _label(label), _type(type), _storage(storage), _count(count)
+{
+}
+
+void Knob::set_value(double value, int index)
+{
+	if (index < 0 || index >= _count)
+		return;
+	switch (_type){
+	case INT:
+		static_cast<int*>(_storage)[index] = int(value);
+		break;
+	case BOOL:
+		static_cast<bool*>(_storage)[index] = value != 0.0;
+		break;
+	case FLOAT:
+		static_cast<float*>(_storage)[index] = float(value);
+		break;
+	case DOUBLE:
+		static_cast<double*>(_storage)[index] = value;
+		break;
+	case CHANNEL:
+		static_cast<Channel*>(_storage)[index] = Channel(int(value));
+		break;
+	default:
+		break;
+	}
+}
+
+double Knob::get_value(int index) const
+{
+	if (index < 0 || index >= _count)
+		return 0.0;
+	switch (_type){
+	case INT:
+		return static_cast<const int*>(_storage)[index];
+	case BOOL:
+		return static_cast<const bool*>(_storage)[index] ? 1.0 : 0.0;
+	case FLOAT:
+		return static_cast<const float*>(_storage)[index];
+	case DOUBLE:
+		return static_cast<const double*>(_storage)[index];
+	case CHANNEL:
+		return static_cast<const Channel*>(_storage)[index];
+	default:
+		return 0.0;
+	}
+}
+
+bool Knob::from_script(const char* script)
+{
+	if (_type == CURVES){
+		// "{y C 0 1} {y C 0 x0.5 0.8 x1 1} ..." sets the curves in order
+		int curve = 0;
+		const char* p = script ? script : "";
+		while ((p = strchr(p, '{'))){
+			const char* start = ++p;
+			int depth = 1;
+			while (*p && depth){
+				depth += *p == '{' ? 1 : *p == '}' ? -1 : 0;
+				p++;
+			}
+			static_cast<LookupCurves*>(_storage)->setCurve(curve++, std::string(start, p - start).c_str());
+		}
+		return curve > 0;
+	}
+
+	double v[7];
+	int n = 0;
+	const char* p = script ? script : "";
+	while (n < 7){
+		char* end = 0;
+		v[n] = strtod(p, &end);
+		if (end == p)
+			break;
+		p = end;
+		n++;
+	}
+	if (!n)
+		return false;
+
+	if (_type == FORMAT){
+		if (n < 2)
+			return false;
+		Format f((int)v[0], (int)v[1]);
+		if (n >= 6)
+			f.set(int(v[2]), int(v[3]), int(v[4]), int(v[5]));
+		if (n >= 7)
+			f.pixel_aspect(v[6]);
+		static_cast<FormatPair*>(_storage)->format(&f);
+		return true;
+	}
+	for (int i=0; i < n && i < _count; i++)
+		set_value(v[i], i);
+	return true;
+}
+
+void Knob::append(Hash& hash) const
+{
+	switch (_type){
+	case INT:
+		hash.append(_storage, sizeof(int) * _count);
+		break;
+	case BOOL:
+		hash.append(_storage, sizeof(bool) * _count);
+		break;
+	case FLOAT:
+		hash.append(_storage, sizeof(float) * _count);
+		break;
+	case DOUBLE:
+		hash.append(_storage, sizeof(double) * _count);
+		break;
+	case CHANNEL:
+		hash.append(_storage, sizeof(Channel) * _count);
+		break;
+	case FORMAT:{
+		const Format& f = *static_cast<const FormatPair*>(_storage)->format();
+		hash.append(f.x());
+		hash.append(f.y());
+		hash.append(f.r());
+		hash.append(f.t());
+		hash.append(f.pixel_aspect());
+		break;
+	}
+	case CURVES:
+		static_cast<const LookupCurves*>(_storage)->append(hash);
+		break;
+	case STRING:
+		hash.append(*static_cast<const char* const*>(_storage));
+		break;
+	default:
+		break;
+	}
+}
+
+Knob_Closure::~Knob_Closure()
+{
+	for (size_t i=0; i < _knobs.size(); i++)
+		delete _knobs[i];
+}
+
+Knob* Knob_Closure::add(const char* name, const char* label, Knob::Type type, void* storage, int count)
+{
+	_knobs.push_back(new Knob(name, label, type, storage, count));
+	return _knobs.back();
+}
+
+Knob* Knob_Closure::find(const char* name) const
+{
+	for (size_t i=0; i < _knobs.size(); i++)
+		if (_knobs[i]->is(name))
+			return _knobs[i];
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// lookup curves
+
+LookupCurves::LookupCurves(const CurveDescription* descriptions)
+{
+	for (; descriptions && descriptions->name; descriptions++){
+		_curves.push_back(std::vector<Key>());
+		setCurve(int(_curves.size()) - 1, descriptions->defaultValue);
+	}
+}
+
+void LookupCurves::setCurve(int curve, const char* script)
+{
+	if (curve < 0 || curve >= int(_curves.size()))
+		return;
+
+	std::vector<Key> keys;
+	double x = 0.0;
+	const char* p = script ? script : "";
+	while (*p){
+		if (isspace((unsigned char)*p) || *p == '{' || *p == '}'){
+			p++;
+			continue;
+		}
+		char* end = 0;
+		if (*p == 'x'){
+			x = strtod(p + 1, &end);
+		} else {
+			const double y = strtod(p, &end);
+			if (end != p){
+				Key k = {x, y};
+				keys.push_back(k);
+				x += 1.0;
+			}
+		}
+		// skip words such as "y" and "C"
+		if (!end || end == p)
+			while (*p && !isspace((unsigned char)*p))
+				p++;
+		else
+			p = end;
+	}
+
+	if (keys.empty()){
+		Key a = {0.0, 0.0}, b = {1.0, 1.0};
+		keys.push_back(a);
+		keys.push_back(b);
+	}
+	_curves[curve].swap(keys);
+}
+
+double LookupCurves::getValue(int curve, double x) const
+{
+	if (curve < 0 || curve >= int(_curves.size()))
+		return x;
+	const std::vector<Key>& keys = _curves[curve];
+	if (keys.size() == 1)
+		return keys[0].y;
+
+	// segment holding x, the end ones extrapolate their slope
+	size_t i = 1;
+	while (i + 1 < keys.size() && x > keys[i].x)
+		i++;
+	const Key& a = keys[i - 1];
+	const Key& b = keys[i];
+	if (b.x == a.x)
+		return b.y;
+	return a.y + (b.y - a.y) * (x - a.x) / (b.x - a.x);
+}
+
+void LookupCurves::append(Hash& hash) const
+{
+	for (size_t c=0; c < _curves.size(); c++){
+		hash.append(unsigned(_curves[c].size()));
+		if (!_curves[c].empty())
+			hash.append(&_curves[c][0], sizeof(Key) * _curves[c].size());
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// op
+
+static std::vector<const Op::Description*>& descriptions()
+{
+	static std::vector<const Op::Description*> list;
+	return list;
+}
+
+Op::Description::Description(const char* n, const char* m, Op* (*constructor)(Node*))
+	: _constructor(constructor), name(n), menu(m)
+{
+	add();
+}
+
+Op::Description::Description(const char* n, Op* (*constructor)(Node*))
+	: _constructor(constructor), name(n), menu(0)
+{
+	add();
+}
+
+void Op::Description::add()
+{
+	descriptions().push_back(this);
+}
+
+const Op::Description* Op::Description::find(const char* name)
+{
+	for (size_t i=0; i < descriptions().size(); i++)
+		if (!strcmp(descriptions()[i]->name, name))
+			return descriptions()[i];
+	return 0;
+}
+
+size_t Op::Description::count()
+{
+	return descriptions().size();
+}
+
+const Op::Description* Op::Description::get(size_t i)
+{
+	return i < descriptions().size() ? descriptions()[i] : 0;
+}
+
+Op::Op(Node* node)
+	: _node(node), _knobs(0), _valid(false), _opened(false), _aborted(false)
+{
+	if (_node && !_node->_first)
+		_node->_first = this;
+}
+
+Op::~Op()
+{
+	if (_node && _node->_first == this)
+		_node->_first = 0;
+	delete _knobs;
+}
+
+void Op::set_input(int n, Op* op)
+{
+	if (n < 0)
+		return;
+	if (n >= inputs())
+		inputs(n + 1);
+	_inputs[n] = op;
+}
+
+Knob_Closure& Op::closure()
+{
+	// knob storage lives as long as the op, so one pass through knobs() is enough
+	if (!_knobs){
+		_knobs = new Knob_Closure;
+		knobs(*_knobs);
+	}
+	return *_knobs;
+}
+
+Knob* Op::knob(const char* name)
+{
+	return closure().find(name);
+}
+
+void Op::validate(bool for_real)
+{
+	for (size_t i=0; i < _inputs.size(); i++)
+		if (_inputs[i])
+			_inputs[i]->validate(for_real);
+
+	Hash hash;
+	hash.append(Class());
+	const Knob_Closure& f = closure();
+	for (size_t i=0; i < f.size(); i++)
+		f[i]->append(hash);
+	append(hash);
+	for (size_t i=0; i < _inputs.size(); i++)
+		hash.append(_inputs[i] ? _inputs[i]->hash().value() : U64(0));
+	_hash = hash;
+
+	_error.clear();
+	_aborted = false;
+	_validate(for_real);
+	_valid = true;
+	_opened = false;
+}
+
+void Op::open()
+{
+	if (_opened)
+		return;
+	Guard guard(_openLock);
+	if (_opened)
+		return;
+	if (!_valid)
+		validate(true);
+	_open();
+	__sync_synchronize();
+	_opened = true;
+}
+
+void Op::close()
+{
+	Guard guard(_openLock);
+	if (_opened)
+		_close();
+	_opened = false;
+}
+
+void Op::error(const char* format, ...)
+{
+	char message[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	_error = message;
+}
+
+void Op::warning(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fprintf(stderr, "%s: warning: ", Class());
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// iop
+
+Iop::Description::Description(const char* n, const char* m, Iop* (*constructor)(Node*))
+	: Op::Description(n, m, 0), _iopConstructor(constructor)
+{
+}
+
+Iop::Description::Description(const char* n, Iop* (*constructor)(Node*))
+	: Op::Description(n, 0), _iopConstructor(constructor)
+{
+}
+
+void Iop::request(int x, int y, int r, int t, ChannelMask channels, int count)
+{
+	_request(x, y, r, t, channels, count);
+}
+
+void Iop::_request(int x, int y, int r, int t, ChannelMask channels, int count)
+{
+	for (int i=0; i < inputs(); i++){
+		if (!input(i))
+			continue;
+		ChannelSet c(channels);
+		in_channels(i, c);
+		input(i)->request(x, y, r, t, c, count);
+	}
+}
+
+void Iop::get(int y, int x, int r, ChannelMask channels, Row& row)
+{
+	open();
+
+	const ChannelSet live = channels & info_.channels();
+	const ChannelSet dead = channels - live;
+	if (!dead.empty())
+		row.erase(dead);
+	if (live.empty() || x >= r)
+		return;
+	if (info_.w() <= 0 || info_.h() <= 0){
+		row.erase(live);
+		return;
+	}
+
+	const int ly = info_.clampy(y);
+	const int lx = std::max(x, info_.x());
+	const int lr = std::min(r, info_.r());
+	if (lx < lr){
+		engine(ly, lx, lr, live, row);
+		foreach (z, live){
+			float* out = row.writable(z);
+			std::fill(out + x, out + lx, out[lx]);
+			std::fill(out + lr, out + r, out[lr - 1]);
+		}
+		return;
+	}
+
+	// entirely left or right of the box, repeat its edge column
+	const int ex = info_.clampx(x);
+	Row edge(ex, ex + 1);
+	engine(ly, ex, ex + 1, live, edge);
+	foreach (z, live){
+		float* out = row.writable(z);
+		std::fill(out + x, out + r, edge[z][ex]);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// row
+
+Row::Row(int x, int r)
+	: _x(x), _r(std::max(x, r))
+{
+	for (int i=0; i < Chan_Last; i++)
+		_buffers[i] = 0;
+}
+
+Row::~Row()
+{
+	for (int i=0; i < Chan_Last; i++)
+		free(_buffers[i]);
+}
+
+float* Row::buffer(Channel z) const
+{
+	if (!_buffers[z])
+		_buffers[z] = static_cast<float*>(calloc(std::max(_r - _x, 1), sizeof(float)));
+	return _buffers[z] - _x;
+}
+
+void Row::erase(Channel z)
+{
+	float* out = writable(z);
+	std::fill(out + _x, out + _r, 0.0f);
+}
+
+void Row::erase(ChannelMask channels)
+{
+	foreach (z, channels)
+		erase(z);
+}
+
+void Row::copy(const Row& source, ChannelMask channels, int x, int r)
+{
+	foreach (z, channels){
+		const float* in = source[z];
+		std::copy(in + x, in + r, writable(z) + x);
+	}
+}
+
+void Row::get(Iop& input, int y, int x, int r, ChannelMask channels)
+{
+	input.get(y, x, r, channels, *this);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// tile
+
+Tile::Tile(Iop& input, int x, int y, int r, int t, ChannelMask channels, bool multithreaded)
+	: _input(input), _box(x, y, std::max(x, r), std::max(y, t)),
+	  _channels(channels & input.info().channels()), _valid(true)
+{
+	const size_t size = (size_t)_box.w() * _box.h();
+	if (!size)
+		return;
+	foreach (z, channels)
+		_planes[z].resize(size);
+
+	const unsigned nThreads = multithreaded ? std::max(1u, std::min(Thread::numThreads, unsigned(_box.h()))) : 1u;
+	if (nThreads > 1){
+		Thread::spawn(fetchThread, nThreads, this);
+		Thread::wait(this);
+	} else {
+		fetch(_box.y(), _box.t());
+	}
+	_valid = !_input.aborted();
+}
+
+void Tile::fetchThread(unsigned index, unsigned nThreads, void* data)
+{
+	Tile& tile = *static_cast<Tile*>(data);
+	const int rows = tile._box.h();
+	tile.fetch(tile._box.y() + (int)((long long)rows * index / nThreads),
+		tile._box.y() + (int)((long long)rows * (index + 1) / nThreads));
+}
+
+void Tile::fetch(int y0, int y1)
+{
+	const int width = _box.w();
+	Row row(_box.x(), _box.r());
+	ChannelSet wanted;
+	for (int z=Chan_Red; z < Chan_Last; z++)
+		if (!_planes[z].empty())
+			wanted += Channel(z);
+
+	for (int y=y0; y < y1; y++){
+		if (_input.aborted())
+			return;
+		row.get(_input, y, _box.x(), _box.r(), wanted);
+		foreach (z, wanted){
+			const float* in = row[z] + _box.x();
+			std::copy(in, in + width, &_planes[z][(size_t)(y - _box.y()) * width]);
+		}
+	}
+}
+
+Tile::Plane Tile::operator[](Channel z) const
+{
+	const float* data = _planes[z].empty() ? 0 : &_planes[z][0];
+	return Plane(data, _box.x(), _box.y(), _box.w());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// wrapper
+
+NukeWrapper::NukeWrapper(Iop* iop)
+	: Iop(0), _iop(iop)
+{
+}
+
+NukeWrapper::~NukeWrapper()
+{
+	delete _iop;
+}
+
+void NukeWrapper::set_input(int n, Op* op)
+{
+	Op::set_input(n, op);
+	_iop->set_input(n, op);
+}
+
+void NukeWrapper::setOutputContext(const OutputContext& context)
+{
+	Op::setOutputContext(context);
+	_iop->setOutputContext(context);
+}
+
+void NukeWrapper::_validate(bool for_real)
+{
+	_iop->validate(for_real);
+	if (_iop->errorMessage())
+		error("%s", _iop->errorMessage());
+	info_ = _iop->info();
+	set_out_channels(_iop->out_channels());
+}
+
+void NukeWrapper::_request(int x, int y, int r, int t, ChannelMask channels, int count)
+{
+	_iop->request(x, y, r, t, channels, count);
+}
+
+void NukeWrapper::engine(int y, int x, int r, ChannelMask channels, Row& row)
+{
+	_iop->get(y, x, r, channels, row);
+}
+
+}
+}
@@ -0,0 +1,79 @@
+/* Box.h
+Stand-in for the NDK integer box, x/y inclusive and r/t exclusive
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_BOX_H
+#define NKTOOLS_STANDIN_BOX_H
+
+#include <algorithm>
+
+namespace DD {
+namespace Image {
+
+class Box {
+	int _x, _y, _r, _t;
+
+public:
+	Box() : _x(0), _y(0), _r(1), _t(1) {}
+	Box(int x, int y, int r, int t) : _x(x), _y(y), _r(r), _t(t) {}
+
+	int x() const { return _x; }
+	int y() const { return _y; }
+	int r() const { return _r; }
+	int t() const { return _t; }
+	int w() const { return _r - _x; }
+	int h() const { return _t - _y; }
+
+	void x(int v) { _x = v; }
+	void y(int v) { _y = v; }
+	void r(int v) { _r = v; }
+	void t(int v) { _t = v; }
+
+	void set(int x, int y, int r, int t) { _x = x; _y = y; _r = r; _t = t; }
+	void set(const Box& b) { *this = b; }
+
+	void merge(const Box& b)
+	{
+		_x = std::min(_x, b._x);
+		_y = std::min(_y, b._y);
+		_r = std::max(_r, b._r);
+		_t = std::max(_t, b._t);
+	}
+
+	void intersect(const Box& b)
+	{
+		_x = std::max(_x, b._x);
+		_y = std::max(_y, b._y);
+		_r = std::min(_r, b._r);
+		_t = std::min(_t, b._t);
+	}
+
+	int clampx(int x) const { return x < _x ? _x : x >= _r ? _r - 1 : x; }
+	int clampy(int y) const { return y < _y ? _y : y >= _t ? _t - 1 : y; }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,121 @@
+/* ChannelSet.h
+Stand-in for the NDK channel set, a bit mask over a fixed channel list
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_CHANNELSET_H
+#define NKTOOLS_STANDIN_CHANNELSET_H
+
+namespace DD {
+namespace Image {
+
+/*! The channels the plugins and drivers know about. Chan_Black is the
+ * "no channel" value, as it is in the NDK.
+ */
+enum Channel {
+	Chan_Black = 0,
+	Chan_Red,
+	Chan_Green,
+	Chan_Blue,
+	Chan_Alpha,
+	Chan_Z,
+	Chan_U,
+	Chan_V,
+	Chan_Backward_U,
+	Chan_Backward_V,
+	Chan_Stereo_Disp_Left_X,
+	Chan_Stereo_Disp_Left_Y,
+	Chan_Stereo_Disp_Right_X,
+	Chan_Stereo_Disp_Right_Y,
+	Chan_Mask,
+	Chan_Last
+};
+
+enum ChannelSetInit {
+	Mask_None = 0,
+	Mask_Red = 1 << Chan_Red,
+	Mask_Green = 1 << Chan_Green,
+	Mask_Blue = 1 << Chan_Blue,
+	Mask_Alpha = 1 << Chan_Alpha,
+	Mask_Z = 1 << Chan_Z,
+	Mask_RGB = Mask_Red | Mask_Green | Mask_Blue,
+	Mask_RGBA = Mask_RGB | Mask_Alpha,
+	Mask_All = (1 << Chan_Last) - 2
+};
+
+class ChannelSet {
+	unsigned _mask;
+
+	static unsigned bit(Channel z) { return z > Chan_Black && z < Chan_Last ? 1u << z : 0u; }
+
+public:
+	ChannelSet() : _mask(0) {}
+	ChannelSet(ChannelSetInit init) : _mask(unsigned(init) & unsigned(Mask_All)) {}
+	ChannelSet(Channel z) : _mask(bit(z)) {}
+
+	bool empty() const { return !_mask; }
+	bool contains(Channel z) const { return (_mask & bit(z)) != 0; }
+	bool contains(const ChannelSet& other) const { return (_mask & other._mask) == other._mask; }
+	unsigned size() const { return __builtin_popcount(_mask); }
+	unsigned value() const { return _mask; }
+
+	Channel first() const { return next(Chan_Black); }
+	Channel next(Channel z) const
+	{
+		for (int i = z + 1; i < Chan_Last; i++)
+			if (_mask & (1u << i))
+				return Channel(i);
+		return Chan_Black;
+	}
+
+	ChannelSet& operator+=(Channel z) { _mask |= bit(z); return *this; }
+	ChannelSet& operator-=(Channel z) { _mask &= ~bit(z); return *this; }
+	ChannelSet& operator+=(const ChannelSet& other) { _mask |= other._mask; return *this; }
+	ChannelSet& operator-=(const ChannelSet& other) { _mask &= ~other._mask; return *this; }
+	ChannelSet& operator&=(const ChannelSet& other) { _mask &= other._mask; return *this; }
+
+	ChannelSet operator+(const ChannelSet& other) const { ChannelSet s(*this); return s += other; }
+	ChannelSet operator-(const ChannelSet& other) const { ChannelSet s(*this); return s -= other; }
+	ChannelSet operator&(const ChannelSet& other) const { ChannelSet s(*this); return s &= other; }
+
+	bool operator==(const ChannelSet& other) const { return _mask == other._mask; }
+	bool operator!=(const ChannelSet& other) const { return _mask != other._mask; }
+};
+
+typedef const ChannelSet& ChannelMask;
+
+inline bool intersect(const ChannelSet& set, Channel z) { return set.contains(z); }
+inline bool intersect(const ChannelSet& a, const ChannelSet& b) { return !(a & b).empty(); }
+
+//! rgba position of a channel, 3 for anything that is not a colour
+inline int colourIndex(Channel z) { return z >= Chan_Red && z <= Chan_Alpha ? z - Chan_Red : 3; }
+
+const char* getName(Channel z);
+
+}
+}
+
+#define foreach(VAR, CHANNELS) \
+	for (DD::Image::Channel VAR = (CHANNELS).first(); VAR; VAR = (CHANNELS).next(VAR))
+
+#endif
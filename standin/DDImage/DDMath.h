@@ -0,0 +1,55 @@
+/* DDMath.h
+Stand-in for the NDK math helpers the plugins use
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_DDMATH_H
+#define NKTOOLS_STANDIN_DDMATH_H
+
+#include <math.h>
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+namespace DD {
+namespace Image {
+
+template <class T>
+inline T clamp(T v, T lo, T hi) { return v < lo ? lo : v > hi ? hi : v; }
+
+template <class T>
+inline T clamp(T v) { return v < T(0) ? T(0) : v > T(1) ? T(1) : v; }
+
+template <class T>
+inline T lerp(T a, T b, T t) { return a + (b - a) * t; }
+
+inline int fast_floor(float v) { const int i = int(v); return i - (v < float(i)); }
+
+}
+}
+
+#endif
@@ -0,0 +1,64 @@
+/* Format.h
+Stand-in for the NDK image format and the format knob's storage
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_FORMAT_H
+#define NKTOOLS_STANDIN_FORMAT_H
+
+#include "DDImage/Box.h"
+
+namespace DD {
+namespace Image {
+
+class Format : public Box {
+	double _aspect;
+
+public:
+	Format() : Box(0, 0, 1920, 1080), _aspect(1.0) {}
+	Format(int width, int height, double aspect = 1.0) : Box(0, 0, width, height), _aspect(aspect) {}
+
+	int width() const { return w(); }
+	int height() const { return h(); }
+	double pixel_aspect() const { return _aspect; }
+	void width(int v) { r(x() + v); }
+	void height(int v) { t(y() + v); }
+	void pixel_aspect(double v) { _aspect = v; }
+};
+
+/*! Storage behind Format_knob. Without a root format to fall back to,
+ * format(0) resets to the 1920x1080 default.
+ */
+class FormatPair {
+	Format _format;
+
+public:
+	Format* format() const { return const_cast<Format*>(&_format); }
+	Format* fullSizeFormat() const { return format(); }
+	void format(const Format* f) { _format = f ? *f : Format(); }
+};
+
+}
+}
+
+#endif
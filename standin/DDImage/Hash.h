@@ -0,0 +1,74 @@
+/* Hash.h
+Stand-in for the NDK 64 bit hash, FNV-1a over the appended bytes
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_HASH_H
+#define NKTOOLS_STANDIN_HASH_H
+
+#include <stddef.h>
+#include <string.h>
+
+typedef unsigned long long U64;
+
+namespace DD {
+namespace Image {
+
+class Hash {
+	U64 _value;
+
+public:
+	Hash() : _value(0xcbf29ce484222325ULL) {}
+
+	U64 value() const { return _value; }
+	void reset() { _value = 0xcbf29ce484222325ULL; }
+
+	void append(const void* data, size_t length)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < length; i++){
+			_value ^= bytes[i];
+			_value *= 0x100000001b3ULL;
+		}
+	}
+
+	void append(bool v) { append(&v, sizeof(v)); }
+	void append(int v) { append(&v, sizeof(v)); }
+	void append(unsigned v) { append(&v, sizeof(v)); }
+	void append(long v) { append(&v, sizeof(v)); }
+	void append(unsigned long v) { append(&v, sizeof(v)); }
+	void append(long long v) { append(&v, sizeof(v)); }
+	void append(U64 v) { append(&v, sizeof(v)); }
+	void append(float v) { append(&v, sizeof(v)); }
+	void append(double v) { append(&v, sizeof(v)); }
+	void append(const char* s) { if (s) append(s, strlen(s) + 1); }
+	void append(const Hash& h) { append(h._value); }
+
+	bool operator==(const Hash& other) const { return _value == other._value; }
+	bool operator!=(const Hash& other) const { return _value != other._value; }
+};
+
+}
+}
+
+#endif
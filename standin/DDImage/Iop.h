@@ -0,0 +1,119 @@
+/* Iop.h
+Stand-in for the NDK image op: bounding box, channels, request and the
+row engine
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_IOP_H
+#define NKTOOLS_STANDIN_IOP_H
+
+#include "DDImage/Op.h"
+#include "DDImage/Box.h"
+#include "DDImage/ChannelSet.h"
+#include "DDImage/Format.h"
+
+namespace DD {
+namespace Image {
+
+class Row;
+
+class IopInfo : public Box {
+	Format _format;
+	Format _fullSizeFormat;
+	ChannelSet _channels;
+	bool _blackOutside;
+
+public:
+	IopInfo() : Box(0, 0, 0, 0), _blackOutside(false) {}
+
+	const Format& format() const { return _format; }
+	const Format& full_size_format() const { return _fullSizeFormat; }
+	void format(const Format& f) { _format = f; }
+	void full_size_format(const Format& f) { _fullSizeFormat = f; }
+
+	const ChannelSet& channels() const { return _channels; }
+	void channels(const ChannelSet& c) { _channels = c; }
+	void turn_on(const ChannelSet& c) { _channels += c; }
+	void turn_off(const ChannelSet& c) { _channels -= c; }
+
+	bool black_outside() const { return _blackOutside; }
+	void black_outside(bool v) { _blackOutside = v; }
+};
+
+class Iop : public Op {
+public:
+	class Description : public Op::Description {
+		Iop* (*_iopConstructor)(Node*);
+
+	public:
+		Description(const char* n, const char* m, Iop* (*constructor)(Node*));
+		Description(const char* n, Iop* (*constructor)(Node*));
+
+		Op* build(Node* node) const { return _iopConstructor(node); }
+	};
+
+	Iop(Node* node) : Op(node) {}
+
+	Iop* input(int n) const { return static_cast<Iop*>(Op::input(n)); }
+	Iop& input0() const { return *input(0); }
+
+	const IopInfo& info() const { return info_; }
+	const Format& format() const { return info_.format(); }
+	int x() const { return info_.x(); }
+	int y() const { return info_.y(); }
+	int r() const { return info_.r(); }
+	int t() const { return info_.t(); }
+	const ChannelSet& channels() const { return info_.channels(); }
+
+	const ChannelSet& out_channels() const { return _outChannels; }
+	void set_out_channels(const ChannelSet& c) { _outChannels = c; }
+	void copy_info() { if (input(0)) info_ = input0().info(); }
+	void copy_info(int n) { if (input(n)) info_ = input(n)->info(); }
+
+	//! Asks for an area before rows are pulled; forwards to _request.
+	void request(int x, int y, int r, int t, ChannelMask channels, int count);
+	void request(ChannelMask channels, int count) { request(x(), y(), r(), t(), channels, count); }
+
+	/*! Fills row with [x, r) of line y. Lines and columns outside the box
+	 * repeat its edge and channels the op does not produce are zero, as
+	 * they are in Nuke.
+	 */
+	void get(int y, int x, int r, ChannelMask channels, Row& row);
+
+	virtual void in_channels(int, ChannelSet&) const {}
+	virtual void engine(int y, int x, int r, ChannelMask channels, Row& row) = 0;
+
+protected:
+	void _validate(bool) { copy_info(); }
+	virtual void _request(int x, int y, int r, int t, ChannelMask channels, int count);
+
+	IopInfo info_;
+
+private:
+	ChannelSet _outChannels;
+};
+
+}
+}
+
+#endif
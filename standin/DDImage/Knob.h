@@ -0,0 +1,114 @@
+/* Knob.h
+Stand-in for the NDK knob, a named view onto an op's member storage
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_KNOB_H
+#define NKTOOLS_STANDIN_KNOB_H
+
+#include <string.h>
+#include <vector>
+#include "DDImage/Hash.h"
+
+namespace DD {
+namespace Image {
+
+class LookupCurves;
+class FormatPair;
+
+//! Knob value ranges; only used for the UI in Nuke, kept for the signatures.
+struct IRange {
+	double min, max;
+	IRange(double lo, double hi) : min(lo), max(hi) {}
+};
+
+class Knob {
+public:
+	enum Type {
+		NONE,
+		INT,
+		BOOL,
+		FLOAT,
+		DOUBLE,
+		CHANNEL,
+		FORMAT,
+		CURVES,
+		STRING
+	};
+
+	enum { STARTLINE = 1 << 0, NO_ANIMATION = 1 << 1, HIDDEN = 1 << 2 };
+
+	Knob(const char* name, const char* label, Type type, void* storage, int count);
+
+	const char* name() const { return _name; }
+	const char* label() const { return _label ? _label : _name; }
+	bool is(const char* name) const { return _name && name && !strcmp(_name, name); }
+	Type type() const { return _type; }
+	int count() const { return _count; }
+
+	//! Sets element index of the storage; channels take the Channel value.
+	void set_value(double value, int index = 0);
+	double get_value(int index = 0) const;
+
+	/*! Sets the knob from its script text: whitespace separated values,
+	 * "w h [x y r t [aspect]]" for formats, or a brace group per curve for
+	 * curves. Returns false if nothing parsed.
+	 */
+	bool from_script(const char* script);
+
+	void append(Hash& hash) const;
+
+private:
+	const char* _name;
+	const char* _label;
+	Type _type;
+	void* _storage;
+	int _count;
+};
+
+/*! What Op::knobs() is handed. It records every knob the op declares so
+ * Op::knob() can find them by name and Op::validate() can hash them.
+ */
+class Knob_Closure {
+	std::vector<Knob*> _knobs;
+
+	Knob_Closure(const Knob_Closure&);
+	Knob_Closure& operator=(const Knob_Closure&);
+
+public:
+	Knob_Closure() {}
+	~Knob_Closure();
+
+	Knob* add(const char* name, const char* label, Knob::Type type, void* storage, int count);
+	Knob* find(const char* name) const;
+	Knob* last() const { return _knobs.empty() ? 0 : _knobs.back(); }
+	size_t size() const { return _knobs.size(); }
+	Knob* operator[](size_t i) const { return _knobs[i]; }
+};
+
+typedef Knob_Closure& Knob_Callback;
+
+}
+}
+
+#endif
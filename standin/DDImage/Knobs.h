@@ -0,0 +1,100 @@
+/* Knobs.h
+Stand-in for the NDK knob declaration functions
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_KNOBS_H
+#define NKTOOLS_STANDIN_KNOBS_H
+
+#include "DDImage/Knob.h"
+#include "DDImage/ChannelSet.h"
+#include "DDImage/Format.h"
+
+namespace DD {
+namespace Image {
+
+inline Knob* Int_knob(Knob_Callback f, int* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::INT, p, 1); }
+
+inline Knob* Bool_knob(Knob_Callback f, bool* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::BOOL, p, 1); }
+
+inline Knob* Float_knob(Knob_Callback f, float* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::FLOAT, p, 1); }
+
+inline Knob* Float_knob(Knob_Callback f, float* p, IRange, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::FLOAT, p, 1); }
+
+inline Knob* Float_knob(Knob_Callback f, double* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::DOUBLE, p, 1); }
+
+inline Knob* Float_knob(Knob_Callback f, double* p, IRange, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::DOUBLE, p, 1); }
+
+inline Knob* WH_knob(Knob_Callback f, float* p, IRange, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::FLOAT, p, 2); }
+
+inline Knob* WH_knob(Knob_Callback f, double* p, IRange, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::DOUBLE, p, 2); }
+
+inline Knob* XY_knob(Knob_Callback f, float* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::FLOAT, p, 2); }
+
+inline Knob* XY_knob(Knob_Callback f, double* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::DOUBLE, p, 2); }
+
+inline Knob* AColor_knob(Knob_Callback f, float* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::FLOAT, p, 4); }
+
+//! The item list only matters to the UI; the value is the item index.
+inline Knob* Enumeration_knob(Knob_Callback f, int* p, const char* const*, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::INT, p, 1); }
+
+inline Knob* Input_Channel_knob(Knob_Callback f, Channel* p, int count, int, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::CHANNEL, p, count); }
+
+inline Knob* Format_knob(Knob_Callback f, FormatPair* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::FORMAT, p, 1); }
+
+inline Knob* LookupCurves_knob(Knob_Callback f, LookupCurves* p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::CURVES, p, 1); }
+
+inline Knob* String_knob(Knob_Callback f, const char** p, const char* n, const char* l = 0)
+{ return f.add(n, l, Knob::STRING, p, 1); }
+
+// layout and help knobs carry no value
+inline Knob* Obsolete_knob(Knob_Callback, const char*, const char*) { return 0; }
+inline Knob* Divider(Knob_Callback, const char* = 0) { return 0; }
+inline Knob* Newline(Knob_Callback, const char* = 0) { return 0; }
+inline Knob* Tab_knob(Knob_Callback, const char*) { return 0; }
+inline Knob* BeginClosedGroup(Knob_Callback, const char*, const char* = 0) { return 0; }
+inline Knob* EndGroup(Knob_Callback) { return 0; }
+inline void Tooltip(Knob_Callback, const char*) {}
+inline void SetRange(Knob_Callback, double, double) {}
+inline void SetFlags(Knob_Callback, int) {}
+inline void ClearFlags(Knob_Callback, int) {}
+
+}
+}
+
+#endif
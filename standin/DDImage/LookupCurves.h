@@ -0,0 +1,66 @@
+/* LookupCurves.h
+Stand-in for the NDK lookup curves, piecewise linear through their keys
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_LOOKUPCURVES_H
+#define NKTOOLS_STANDIN_LOOKUPCURVES_H
+
+#include <vector>
+#include "DDImage/Hash.h"
+
+namespace DD {
+namespace Image {
+
+struct CurveDescription {
+	const char* name;
+	const char* defaultValue;
+};
+
+/*! Curves are parsed from the same "y C 0 x0.5 0.8 x1 1" scripts Nuke
+ * uses: a bare number is a key one unit after the previous one, xN moves
+ * the next key to N. Nuke interpolates smoothly, the stand-in linearly,
+ * so only the default straight curves match exactly.
+ */
+class LookupCurves {
+	struct Key {
+		double x, y;
+	};
+	std::vector<std::vector<Key> > _curves;
+
+public:
+	LookupCurves(const CurveDescription* descriptions);
+
+	size_t size() const { return _curves.size(); }
+	double getValue(int curve, double x) const;
+
+	//! Replaces one curve from a script, as the knob's from_script would.
+	void setCurve(int curve, const char* script);
+
+	void append(Hash& hash) const;
+};
+
+}
+}
+
+#endif
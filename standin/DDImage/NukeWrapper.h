@@ -0,0 +1,69 @@
+/* NukeWrapper.h
+Stand-in for the NDK wrapper; forwards everything to the wrapped op
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_NUKEWRAPPER_H
+#define NKTOOLS_STANDIN_NUKEWRAPPER_H
+
+#include "DDImage/Iop.h"
+
+namespace DD {
+namespace Image {
+
+/*! Nuke's wrapper adds mask and mix knobs around the wrapped op; the
+ * stand-in only passes inputs, knobs and rows through.
+ */
+class NukeWrapper : public Iop {
+	Iop* _iop;
+
+public:
+	NukeWrapper(Iop* iop);
+	~NukeWrapper();
+
+	Iop* wrapped_iop() const { return _iop; }
+
+	const char* Class() const { return _iop->Class(); }
+	const char* node_help() const { return _iop->node_help(); }
+	int minimum_inputs() const { return _iop->minimum_inputs(); }
+	int maximum_inputs() const { return _iop->maximum_inputs(); }
+
+	void set_input(int n, Op* op);
+	void setOutputContext(const OutputContext& context);
+	void knobs(Knob_Callback f) { _iop->knobs(f); }
+	int knob_changed(Knob* k) { return _iop->knob_changed(k); }
+	void append(Hash& hash) { hash.append(_iop->Class()); }
+
+	void engine(int y, int x, int r, ChannelMask channels, Row& row);
+
+protected:
+	void _validate(bool for_real);
+	void _request(int x, int y, int r, int t, ChannelMask channels, int count);
+	void _open() { _iop->open(); }
+	void _close() { _iop->close(); }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,170 @@
+/* Op.h
+Stand-in for the NDK op: inputs, knobs, hash, context and the
+validate/open lifecycle
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_OP_H
+#define NKTOOLS_STANDIN_OP_H
+
+#include <string>
+#include <vector>
+#include "DDImage/Hash.h"
+#include "DDImage/Knob.h"
+#include "DDImage/Thread.h"
+
+namespace DD {
+namespace Image {
+
+class Op;
+class ViewerContext;
+
+/*! Stands in for the node in the script; the ops made for each of its
+ * views and frames share it, and the first of them is their firstOp().
+ */
+class Node {
+	Op* _first;
+	friend class Op;
+
+public:
+	Node() : _first(0) {}
+};
+
+class OutputContext {
+	double _frame;
+	int _view;
+
+public:
+	OutputContext() : _frame(1.0), _view(1) {}
+
+	double frame() const { return _frame; }
+	int view() const { return _view; }
+	void setFrame(double frame) { _frame = frame; }
+	void setView(int view) { _view = view; }
+};
+
+class Op {
+public:
+	/*! Registers a plugin by class name so drivers can build it the way
+	 * Nuke would from a script.
+	 */
+	class Description {
+		Op* (*_constructor)(Node*);
+
+	public:
+		const char* name;
+		const char* menu;
+
+		Description(const char* n, const char* m, Op* (*constructor)(Node*));
+		Description(const char* n, Op* (*constructor)(Node*));
+		virtual ~Description() {}
+
+		virtual Op* build(Node* node) const { return _constructor(node); }
+
+		static const Description* find(const char* name);
+		static size_t count();
+		static const Description* get(size_t i);
+
+	protected:
+		void add();
+	};
+
+	Op(Node* node);
+	virtual ~Op();
+
+	virtual const char* Class() const = 0;
+	virtual const char* node_help() const { return ""; }
+	const char* node_name() const { return Class(); }
+	Node* node() const { return _node; }
+	//! The first op made for the node, or this one without a node.
+	Op* firstOp() const { return _node && _node->_first ? _node->_first : const_cast<Op*>(this); }
+
+	virtual int minimum_inputs() const { return 1; }
+	virtual int maximum_inputs() const { return 1; }
+	int inputs() const { return int(_inputs.size()); }
+	void inputs(int n) { _inputs.resize(n, 0); }
+	Op* input(int n) const { return n < inputs() ? _inputs[n] : 0; }
+	virtual void set_input(int n, Op* op);
+
+	virtual void knobs(Knob_Callback) {}
+	virtual int knob_changed(Knob*) { return 0; }
+	//! The knob called name, or 0; storage is this op's members.
+	Knob* knob(const char* name);
+
+	const OutputContext& outputContext() const { return _context; }
+	virtual void setOutputContext(const OutputContext& context) { _context = context; }
+
+	/*! Validates the inputs, hashes knobs, append() and input hashes, then
+	 * calls _validate. Ops reopen after every validate.
+	 */
+	void validate(bool for_real = true);
+	void invalidate() { _valid = false; }
+	bool valid() const { return _valid; }
+	void open();
+	void close();
+
+	const Hash& hash() const { return _hash; }
+	virtual void append(Hash&) {}
+
+	bool aborted() const { return _aborted; }
+	void abort() { _aborted = true; }
+	void cancel() { _aborted = true; }
+	void progressFraction(double) {}
+	void progressFraction(int, int) {}
+
+	void error(const char* format, ...);
+	void warning(const char* format, ...);
+	const char* errorMessage() const { return _error.empty() ? 0 : _error.c_str(); }
+
+	void build_knob_handles(ViewerContext*) {}
+	void add_draw_handle(ViewerContext*) {}
+	virtual void build_handles(ViewerContext*) {}
+	virtual void draw_handle(ViewerContext*) {}
+
+protected:
+	virtual void _validate(bool) {}
+	virtual void _open() {}
+	virtual void _close() {}
+
+private:
+	Knob_Closure& closure();
+
+	Node* _node;
+	std::vector<Op*> _inputs;
+	Knob_Closure* _knobs;
+	OutputContext _context;
+	Hash _hash;
+	Lock _openLock;
+	bool _valid;
+	volatile bool _opened;
+	volatile bool _aborted;
+	std::string _error;
+
+	Op(const Op&);
+	Op& operator=(const Op&);
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,71 @@
+/* Row.h
+Stand-in for the NDK row: one scanline of float channels over [x, r)
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_ROW_H
+#define NKTOOLS_STANDIN_ROW_H
+
+#include "DDImage/ChannelSet.h"
+
+namespace DD {
+namespace Image {
+
+class Iop;
+
+/*! Buffers are indexed by image x, so row[z][x] is valid for x in [x, r).
+ * A channel reads as zeros until something writes it.
+ */
+class Row {
+	int _x, _r;
+	mutable float* _buffers[Chan_Last];
+	ChannelSet _writable;
+
+	float* buffer(Channel z) const;
+
+	Row(const Row&);
+	Row& operator=(const Row&);
+
+public:
+	Row(int x, int r);
+	~Row();
+
+	int getLeft() const { return _x; }
+	int getRight() const { return _r; }
+
+	const float* operator[](Channel z) const { return buffer(z); }
+	float* writable(Channel z) { _writable += z; return buffer(z); }
+	const ChannelSet& writable_channels() const { return _writable; }
+
+	void erase(Channel z);
+	void erase(ChannelMask channels);
+	void copy(const Row& source, ChannelMask channels, int x, int r);
+
+	//! input.get(y, x, r, channels, *this)
+	void get(Iop& input, int y, int x, int r, ChannelMask channels);
+};
+
+}
+}
+
+#endif
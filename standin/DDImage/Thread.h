@@ -0,0 +1,101 @@
+/* Thread.h
+Stand-in for the NDK locks and thread pool, on top of pthreads
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_THREAD_H
+#define NKTOOLS_STANDIN_THREAD_H
+
+#include <pthread.h>
+
+namespace DD {
+namespace Image {
+
+class Lock {
+	Lock(const Lock&);
+	Lock& operator=(const Lock&);
+
+protected:
+	pthread_mutex_t _mutex;
+
+public:
+	Lock() { pthread_mutex_init(&_mutex, 0); }
+	~Lock() { pthread_mutex_destroy(&_mutex); }
+
+	void lock() { pthread_mutex_lock(&_mutex); }
+	void unlock() { pthread_mutex_unlock(&_mutex); }
+	bool trylock() { return pthread_mutex_trylock(&_mutex) == 0; }
+	void spinlock() { lock(); }
+};
+
+/*! A lock threads can sleep on until another signals them. wait() must be
+ * called with the lock held, and holds it again on return.
+ */
+class SignalLock : public Lock {
+	pthread_cond_t _cond;
+
+public:
+	SignalLock() { pthread_cond_init(&_cond, 0); }
+	~SignalLock() { pthread_cond_destroy(&_cond); }
+
+	void wait() { pthread_cond_wait(&_cond, &_mutex); }
+	//! Wakes every waiting thread.
+	void signal() { pthread_cond_broadcast(&_cond); }
+};
+
+class Guard {
+	Lock& _lock;
+
+	Guard(const Guard&);
+	Guard& operator=(const Guard&);
+
+public:
+	Guard(Lock& lock) : _lock(lock) { _lock.lock(); }
+	~Guard() { _lock.unlock(); }
+};
+
+namespace Thread {
+
+/*! Cores on this machine, and how many threads ops should spread over.
+ * numThreads starts at numCPUs and can be lowered with NKTOOLS_THREADS or
+ * by assigning it directly.
+ */
+extern unsigned numCPUs;
+extern unsigned numThreads;
+
+typedef void (ThreadFunction)(unsigned index, unsigned nThreads, void* data);
+
+//! Start n threads calling f(i, n, data); they run until wait(data).
+void spawn(ThreadFunction* f, int n, void* data);
+
+//! Join every thread spawned with data.
+void wait(void* data);
+
+}
+
+void sleepFor(double seconds);
+
+}
+}
+
+#endif
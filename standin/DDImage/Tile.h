@@ -0,0 +1,86 @@
+/* Tile.h
+Stand-in for the NDK tile: a block of rows pulled from an input
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_TILE_H
+#define NKTOOLS_STANDIN_TILE_H
+
+#include <stddef.h>
+#include <vector>
+#include "DDImage/Iop.h"
+#include "DDImage/Row.h"
+
+namespace DD {
+namespace Image {
+
+/*! tile[z][y][x] for x in [x, r) and y in [y, t). With multithreaded set
+ * the rows are fetched over Thread::numThreads threads.
+ */
+class Tile {
+public:
+	class Plane {
+		const float* _data;
+		int _x, _y, _width;
+
+	public:
+		Plane(const float* data, int x, int y, int width) : _data(data), _x(x), _y(y), _width(width) {}
+		const float* operator[](int y) const { return _data + (ptrdiff_t)(y - _y) * _width - _x; }
+	};
+
+	Tile(Iop& input, int x, int y, int r, int t, ChannelMask channels, bool multithreaded = false);
+
+	int x() const { return _box.x(); }
+	int y() const { return _box.y(); }
+	int r() const { return _box.r(); }
+	int t() const { return _box.t(); }
+	const ChannelSet& channels() const { return _channels; }
+	bool valid() const { return _valid; }
+
+	Plane operator[](Channel z) const;
+
+private:
+	static void fetchThread(unsigned index, unsigned nThreads, void* data);
+	void fetch(int y0, int y1);
+
+	Iop& _input;
+	Box _box;
+	ChannelSet _channels;
+	std::vector<float> _planes[Chan_Last];
+	bool _valid;
+
+	Tile(const Tile&);
+	Tile& operator=(const Tile&);
+};
+
+class Interest : public Tile {
+public:
+	Interest(Iop& input, int x, int y, int r, int t, ChannelMask channels, bool multithreaded = false)
+		: Tile(input, x, y, r, t, channels, multithreaded) {}
+	void unlock() {}
+};
+
+}
+}
+
+#endif
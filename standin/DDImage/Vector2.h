@@ -0,0 +1,55 @@
+/* Vector2.h
+Stand-in for the NDK 2d vector
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_VECTOR2_H
+#define NKTOOLS_STANDIN_VECTOR2_H
+
+#include <math.h>
+
+namespace DD {
+namespace Image {
+
+class Vector2 {
+public:
+	float x, y;
+
+	Vector2() {}
+	Vector2(float a, float b) : x(a), y(b) {}
+
+	float& operator[](int i) { return i ? y : x; }
+	const float& operator[](int i) const { return i ? y : x; }
+
+	Vector2 operator+(const Vector2& v) const { return Vector2(x + v.x, y + v.y); }
+	Vector2 operator-(const Vector2& v) const { return Vector2(x - v.x, y - v.y); }
+	Vector2 operator*(float s) const { return Vector2(x * s, y * s); }
+	float dot(const Vector2& v) const { return x * v.x + y * v.y; }
+	float lengthSquared() const { return x * x + y * y; }
+	float length() const { return sqrtf(lengthSquared()); }
+};
+
+}
+}
+
+#endif
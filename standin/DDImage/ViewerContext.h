@@ -0,0 +1,44 @@
+/* ViewerContext.h
+Stand-in for the NDK viewer context; there is no viewer to draw in
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_VIEWERCONTEXT_H
+#define NKTOOLS_STANDIN_VIEWERCONTEXT_H
+
+namespace DD {
+namespace Image {
+
+enum { VIEWER_2D = 0, VIEWER_PERSP };
+
+class ViewerContext {
+public:
+	int transform_mode() const { return VIEWER_2D; }
+	bool draw_lines() const { return false; }
+	unsigned fg_color() const { return 0xffffffff; }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,49 @@
+/* gl.h
+Stand-in for the NDK GL wrapper; every call is a no-op
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_STANDIN_GL_H
+#define NKTOOLS_STANDIN_GL_H
+
+#define GL_LINES 0x0001
+#define GL_LINE_STIPPLE 0x0B24
+
+inline void glBegin(int) {}
+inline void glEnd() {}
+inline void glEnable(int) {}
+inline void glDisable(int) {}
+inline void glLineWidth(float) {}
+inline void glLineStipple(int, unsigned short) {}
+inline void glVertex2d(double, double) {}
+inline void glVertex2f(float, float) {}
+
+namespace DD {
+namespace Image {
+
+inline void glColor(unsigned) {}
+
+}
+}
+
+#endif
@@ -0,0 +1,442 @@
+/* Reference.h
+The golden results the optimised paths are tested against: the baseline
+nodes' own loops, kept as they were, and straightforward per pixel versions
+of what the nodes compute now, for what has changed on purpose since
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NKTOOLS_REFERENCE_H
+#define NKTOOLS_REFERENCE_H
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "DDImage/DDMath.h"
+#include "DDImage/LookupCurves.h"
+
+/*! A float plane over [x, r) x [y, t). Reads through edge() outside it
+ * repeat its edge, as Iop::get does.
+ */
+struct Plane
+{
+	int x, y, r, t;
+	std::vector<float> pixels;
+
+	Plane() : x(0), y(0), r(0), t(0) {}
+	Plane(int x_, int y_, int r_, int t_, float value = 0.0f) : x(x_), y(y_), r(r_), t(t_),
+		pixels((size_t)std::max(r_ - x_, 0) * std::max(t_ - y_, 0), value) {}
+
+	bool contains(int X, int Y) const { return X >= x && X < r && Y >= y && Y < t; }
+	float& at(int X, int Y) { return pixels[(size_t)(Y - y) * (r - x) + X - x]; }
+	float at(int X, int Y) const { return pixels[(size_t)(Y - y) * (r - x) + X - x]; }
+	float edge(int X, int Y) const
+	{
+		return at(std::min(std::max(X, x), r - 1), std::min(std::max(Y, y), t - 1));
+	}
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// baseline
+
+/* The loops of the nodes as they were before any of the optimised paths,
+ * with the Row and Tile reads of the input made Plane::edge() reads. What
+ * they left undefined, reading past the ends of a row or leaving a channel
+ * unwritten, is NaN, which the comparisons skip.
+ */
+
+/*! The baseline DrivenDilate's get_vpass() and engine() for one channel,
+ * over its info_ [x, r) x [y, t). maxValue is its _maxValue, the largest
+ * mask over the format. With a vertical size the vertical pass skipped the
+ * mask channel, so the horizontal pass that followed saw no mask.
+ */
+inline Plane baselineDilateBox(const Plane& in, const Plane* mask, int x, int y, int r, int t,
+	double w, double h, int bboxAdjust, float maxValue)
+{
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const int h_size = int(fabs(w) + .5);
+	const int h_do_min = w < 0;
+	const int v_size = int(fabs(h) + .5);
+	const int v_do_min = h < 0;
+	const float _maxValue = maxValue;
+	Plane out(x, y, r, t, nan);
+	for (int y0 = y; y0 < t; y0++){
+		// engine(): the vertical pass runs over the row widened by the
+		// largest horizontal window, inside info_
+		float rm = x, rx = r;
+		if (h_size){
+			rm = x - (bboxAdjust + (h_size * _maxValue));
+			if (rm < x)
+				rm = x;
+			rx = r + (bboxAdjust + (h_size * _maxValue));
+			if (rx > r)
+				rx = r;
+		}
+		const int left = rm, right = rx;
+		std::vector<float> row(right - left), driven(right - left, 0.0f);
+
+		// get_vpass()
+		if (!v_size){
+			for (int X = left; X < right; X++){
+				row[X - left] = in.edge(X, y0);
+				driven[X - left] = mask ? mask->edge(X, y0) : 0.0f;
+			}
+		} else {
+			float tm = y0 - (v_size * _maxValue);
+			if (tm < y)
+				tm = y;
+			float tx = y0 + (v_size*_maxValue);
+			if (tx > t)
+				tx = t;
+			const int tileY = tm, tileT = tx + 1;
+			for (int X = left; X < right; X++){
+				float TO = in.edge(X, y0);
+				float mval = mask ? mask->edge(X, y0) : 0.0f;
+				int start = y0 - (v_size*mval);
+				if (start < tileY)
+					start = tileY;
+				int end = y0 + (v_size*mval);
+				if (end > tileT)
+					end = tileT;
+
+				for (int Y=start; Y < end; Y++){
+					if (v_do_min){
+						if (in.edge(X, Y) < TO)
+							TO = in.edge(X, Y);
+					} else {
+						if (in.edge(X, Y) > TO)
+							TO = in.edge(X, Y);
+					}
+				}
+				row[X - left] = TO;
+			}
+		}
+
+		if (!h_size){
+			for (int X = x; X < r; X++)
+				out.at(X, y0) = row[X - left];
+			continue;
+		}
+		for (int X=x; X < r; X++){
+			float mval = driven[X - left];
+			int np = (X - (int)(h_size * mval));
+			int pp = (X + (int)(h_size * mval));
+			// past the ends of the row the baseline read undefined memory
+			if (np < pp && (np < left || pp > right))
+				continue;
+			float v = row[X - left];
+			for (int cx=np; cx < pp; cx++){
+				if (h_do_min){
+					v = MIN(v, row[cx - left]);
+				} else {
+					v = MAX(v, row[cx - left]);
+				}
+			}
+			out.at(X, y0) = v;
+		}
+	}
+	return out;
+}
+
+/*! The baseline DisparityDistort's engine(), which copied each row of the
+ * input from a row that ended mst short of its info_ [x, r) x [y, t).
+ */
+inline Plane baselineDistort(const Plane& in, float mst, int x, int y, int r, int t)
+{
+	Plane out(x, y, r, t, std::numeric_limits<float>::quiet_NaN());
+	const int left = x - mst, right = r - mst;
+	for (int Y = y; Y < t; Y++){
+		for (int X = std::max(x, left); X < std::min(r, right); X++)
+			out.at(X, Y) = in.edge(X, Y);
+	}
+	return out;
+}
+
+/*! The baseline Ramp2's engine() for channel z, a linear ramp from color 0
+ * at p0 to color 1 at p1 worked out in floats, or lut the curves run on it.
+ */
+inline Plane baselineRamp(const float* low_col, const float* hi_col, const double* p0, const double* p1,
+	const DD::Image::LookupCurves* lut, int z, int x, int y, int r, int t)
+{
+	Plane out(x, y, r, t, std::numeric_limits<float>::quiet_NaN());
+	const float p0x = p0[0], p0y = p0[1], p1x = p1[0], p1y = p1[1];
+	const float rVx = p1x - p0x, rVy = p1y - p0y;
+	for (int Y = y; Y < t; Y++){
+		for (int X = x; X < r; X++){
+			if (low_col[z] || hi_col[z]){
+				float c1 = rVx * p0x + rVy * p0y;
+				float c2 = rVx * p1x + rVy * p1y;
+				float c = rVx * X + rVy * Y;
+				float pixcol = (low_col[z] * (c2 - c) + hi_col[z] * (c - c1))/(c2 - c1);
+
+				float o = DD::Image::clamp(pixcol, std::min(low_col[z], hi_col[z]), std::max(low_col[z], hi_col[z]));
+				if (lut){
+					if (low_col[z] > hi_col[z]){
+						// invert colors, run lut, then revert
+						o = (o*-1)+1;
+						o = float(lut->getValue(0, o));
+						o = float(lut->getValue(z + 1, o));
+						o = (o*-1)+1;
+					} else {
+						o = float(lut->getValue(0, o));
+						o = float(lut->getValue(z + 1, o));
+					}
+				}
+				out.at(X, Y) = o;
+			}
+		}
+	}
+	return out;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// now
+
+/*! DrivenDilate's box shape over the output box [x, r) x [y, t): each
+ * pixel takes the min or max of a column window, then of a row window of
+ * the column results, both scaled by the mask at the pixel. The windows
+ * end at truncated floats and stop at the output box. Without a mask
+ * nothing moves.
+ *
+ * Unlike the baseline, the mask drives the row windows after the column
+ * ones too, the windows stop at the output box rather than reading past
+ * the rows, and the mask's range is taken over the input's bbox rather
+ * than the format.
+ */
+inline Plane referenceDilateBox(const Plane& in, const Plane* mask, int x, int y, int r, int t,
+	int hSize, int vSize, bool hMin, bool vMin)
+{
+	Plane column(x, y, r, t);
+	for (int Y = y; Y < t; Y++){
+		for (int X = x; X < r; X++){
+			float v = in.edge(X, Y);
+			const float m = mask ? mask->edge(X, Y) : 0.0f;
+			const int start = std::max(y, (int)(Y - vSize * m));
+			const int end = std::min(t, (int)(Y + vSize * m));
+			for (int j = start; j < end; j++)
+				v = vMin ? std::min(v, in.edge(X, j)) : std::max(v, in.edge(X, j));
+			column.at(X, Y) = v;
+		}
+	}
+
+	Plane out(x, y, r, t);
+	for (int Y = y; Y < t; Y++){
+		for (int X = x; X < r; X++){
+			float v = column.at(X, Y);
+			const float m = mask ? mask->edge(X, Y) : 0.0f;
+			const int k = (int)(hSize * m);
+			if (k > 0){
+				for (int i = std::max(x, X - k); i < std::min(r, X + k); i++)
+					v = hMin ? std::min(v, column.at(i, Y)) : std::max(v, column.at(i, Y));
+			}
+			out.at(X, Y) = v;
+		}
+	}
+	return out;
+}
+
+/*! DrivenDilate's round shape, which the baseline didn't have: each pixel
+ * takes the min or max of the output box's pixels inside an ellipse of
+ * radii hSize and vSize times the mask at the pixel. A size of 0 flattens
+ * the ellipse to a line, and a mask of 0 or less leaves the pixel alone.
+ */
+inline Plane referenceDilateRound(const Plane& in, const Plane* mask, int x, int y, int r, int t,
+	int hSize, int vSize, bool doMin)
+{
+	Plane out(x, y, r, t);
+	for (int Y = y; Y < t; Y++){
+		for (int X = x; X < r; X++){
+			float v = in.edge(X, Y);
+			const double m = mask ? mask->edge(X, Y) : 0.0;
+			for (int j = y; m > 0 && j < t; j++){
+				const double dy = j - Y;
+				if (!vSize && dy)
+					continue;
+				const double fy = vSize ? dy * dy / ((double)vSize * vSize) : 0.0;
+				for (int i = x; i < r; i++){
+					const double dx = i - X;
+					if (!hSize && dx)
+						continue;
+					const double fx = hSize ? dx * dx / ((double)hSize * hSize) : 0.0;
+					if (fx + fy <= m * m)
+						v = doMin ? std::min(v, in.edge(i, j)) : std::max(v, in.edge(i, j));
+				}
+			}
+			out.at(X, Y) = v;
+		}
+	}
+	return out;
+}
+
+/*! DisparityDistort's forward warp of one plane into [x, r) x [y, t),
+ * where the baseline only copied the input through: each input pixel is
+ * pushed by its rounded disparity, along X and, given
+ * dispY, along Y. Where several land together the nearest wins, the one
+ * pushed furthest left for the left view and furthest right for the
+ * right, then the first in row order. Holes get hole.
+ */
+inline Plane referenceForward(const Plane& in, const Plane& dispX, const Plane* dispY, bool left,
+	int x, int y, int r, int t, float hole)
+{
+	Plane out(x, y, r, t, hole);
+	Plane nearest(x, y, r, t);
+	std::vector<bool> covered(out.pixels.size(), false);
+	for (int Y = in.y; Y < in.t; Y++){
+		for (int X = in.x; X < in.r; X++){
+			const float d = dispX.edge(X, Y);
+			const int T = X + (int)floor(d + 0.5f);
+			const int U = Y + (dispY ? (int)floor(dispY->edge(X, Y) + 0.5f) : 0);
+			if (!out.contains(T, U))
+				continue;
+			const float depth = left ? -d : d;
+			const size_t p = (size_t)(U - y) * (r - x) + T - x;
+			if (!covered[p] || depth > nearest.pixels[p]){
+				covered[p] = true;
+				nearest.pixels[p] = depth;
+				out.pixels[p] = in.at(X, Y);
+			}
+		}
+	}
+	return out;
+}
+
+/*! Samples in at (fx, fy), which are inside its box, bilinearly or from
+ * the nearest pixel. Without hasY only row fy is read.
+ */
+inline float referenceSample(const Plane& in, float fx, float fy, bool hasY, bool bilinear)
+{
+	if (!bilinear)
+		return in.at((int)floor(fx + 0.5f), (int)floor(fy + 0.5f));
+	const int x0 = (int)floor(fx);
+	const int y0 = (int)floor(fy);
+	const int x1 = std::min(x0 + 1, in.r - 1);
+	const float wx = fx - x0;
+	const float top = in.at(x0, y0) + (in.at(x1, y0) - in.at(x0, y0)) * wx;
+	if (!hasY)
+		return top;
+	const int y1 = std::min(y0 + 1, in.t - 1);
+	const float wy = fy - y0;
+	const float bottom = in.at(x0, y1) + (in.at(x1, y1) - in.at(x0, y1)) * wx;
+	return top + (bottom - top) * wy;
+}
+
+/*! DisparityDistort's backward warp of one plane, which the baseline
+ * didn't have: each output pixel samples the input back along the inverse
+ * disparity, the disparity forward warped along itself with NaN holes,
+ * clamped to the input's box. The holes are black.
+ */
+inline Plane referenceBackward(const Plane& in, const Plane& invX, const Plane& invY, bool hasY, bool bilinear)
+{
+	Plane out(invX.x, invX.y, invX.r, invX.t);
+	for (int Y = out.y; Y < out.t; Y++){
+		for (int X = out.x; X < out.r; X++){
+			const float ix = invX.at(X, Y);
+			if (ix != ix)
+				continue;
+			const float fx = std::min(std::max(X - ix, (float)in.x), (float)(in.r - 1));
+			const float fy = std::min(std::max(hasY ? Y - invY.at(X, Y) : (float)Y, (float)in.y), (float)(in.t - 1));
+			out.at(X, Y) = referenceSample(in, fx, fy, hasY, bilinear);
+		}
+	}
+	return out;
+}
+
+//! Ramp2's knobs.
+struct RampSettings
+{
+	enum { LINEAR, RADIAL, ANGULAR };
+
+	double p0[2], p1[2];
+	int mode;
+	float low[4], high[4];
+	int stops;
+	float stopPos[6];
+	float stopCol[6][4];
+	// null with the lut off
+	const DD::Image::LookupCurves* lut;
+};
+
+/*! Where pixel (X, Y) is along the ramp, from 0 to 1: along p0 to p1 for
+ * linear, the distance from p0 over that of p1 for radial, and the angle
+ * around p0 from p1 as a fraction of a turn for angular. With p1 on p0 a
+ * linear or radial ramp sits at 0, where the baseline's was NaN.
+ */
+inline double referenceRampPosition(const RampSettings& s, int X, int Y)
+{
+	const double vx = s.p1[0] - s.p0[0];
+	const double vy = s.p1[1] - s.p0[1];
+	const double dx = X - s.p0[0];
+	const double dy = Y - s.p0[1];
+	if (s.mode != RampSettings::ANGULAR && !vx && !vy)
+		return 0.0;
+	if (s.mode == RampSettings::RADIAL)
+		return std::min(sqrt(dx * dx + dy * dy) / sqrt(vx * vx + vy * vy), 1.0);
+	if (s.mode == RampSettings::ANGULAR){
+		double a = (atan2(dy, dx) - atan2(vy, vx)) / (2 * M_PI);
+		return a - floor(a);
+	}
+	return std::min(std::max((vx * dx + vy * dy) / (vx * vx + vy * vy), 0.0), 1.0);
+}
+
+/*! Ramp2's channel z at position t: a linear blend through the colors of
+ * the stops in order of position, from color 0 at 0 to color 1 at 1, then
+ * the master and channel curves, run upside down for a ramp going down.
+ * Channels that are black everywhere are black, where the baseline left
+ * them unwritten.
+ */
+inline double referenceRampValue(const RampSettings& s, int z, double t)
+{
+	bool active = s.low[z] || s.high[z];
+	std::vector<double> pos(1, 0.0), col(1, s.low[z]);
+	for (int i=0; i < s.stops; i++){
+		active = active || s.stopCol[i][z];
+		const double p = std::min(std::max((double)s.stopPos[i], 0.0), 1.0);
+		size_t j = pos.size();
+		while (j > 1 && pos[j - 1] > p)
+			j--;
+		pos.insert(pos.begin() + j, p);
+		col.insert(col.begin() + j, s.stopCol[i][z]);
+	}
+	pos.push_back(1.0);
+	col.push_back(s.high[z]);
+	if (!active)
+		return 0.0;
+
+	size_t j = 0;
+	while (j + 2 < pos.size() && pos[j + 1] <= t)
+		j++;
+	const double span = pos[j + 1] - pos[j];
+	const double w = span > 0 ? std::min(std::max((t - pos[j]) / span, 0.0), 1.0) : 1.0;
+	double v = col[j] + (col[j + 1] - col[j]) * w;
+	if (s.lut){
+		const bool down = s.low[z] > s.high[z];
+		if (down)
+			v = 1 - v;
+		v = s.lut->getValue(z + 1, s.lut->getValue(0, v));
+		if (down)
+			v = 1 - v;
+	}
+	return v;
+}
+
+#endif
@@ -0,0 +1,1311 @@
+/* nkGolden.cpp
+Runs the optimised paths of the nodes and their kernels against the
+reference loops of Reference.h, on random and edge case inputs
+
+The MIT License (MIT)
+
+Copyright (c) [2013] [Brogan Ross]
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDImage/Format.h"
+#include "DDImage/Iop.h"
+#include "DDImage/LookupCurves.h"
+#include "DDImage/Row.h"
+#include "DDImage/Thread.h"
+#include "DilateKernels.h"
+#include "RampKernels.h"
+#include "WarpKernels.h"
+#include "Reference.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <string>
+
+using namespace DD::Image;
+
+static const char* const USAGE =
+	"usage: nkGolden [options]\n"
+	"  --seed N        first random seed (1)\n"
+	"  --iterations N  random cases per test (40)\n"
+	"  --filter TEXT   only the tests whose name holds TEXT\n";
+
+//////////////////////////////////////////////////////////////////////////////
+// cases
+
+//! xorshift, so a seed gives the same cases everywhere
+class Random {
+	uint32_t _state;
+
+public:
+	Random(uint32_t seed) : _state(seed * 2654435761u + 1u) { next(); }
+
+	uint32_t next()
+	{
+		_state ^= _state << 13;
+		_state ^= _state >> 17;
+		_state ^= _state << 5;
+		return _state;
+	}
+
+	//! an integer in [lo, hi]
+	int range(int lo, int hi) { return lo + int(next() % uint32_t(hi - lo + 1)); }
+	//! a float in [lo, hi)
+	float uniform(float lo, float hi) { return lo + (hi - lo) * float(next() >> 8) * (1.0f / 16777216.0f); }
+	bool chance(float p) { return uniform(0.0f, 1.0f) < p; }
+};
+
+static std::string format(const char* fmt, ...)
+{
+	char text[512];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+	return text;
+}
+
+/*! Mostly small boxes off the origin, so edges and negative coordinates
+ * are everywhere, now and then a single row or column.
+ */
+static Box randomBox(Random& random)
+{
+	const int x = random.range(-40, 40);
+	const int y = random.range(-40, 40);
+	const int w = random.chance(0.1f) ? 1 : random.range(1, 64);
+	const int h = random.chance(0.1f) ? 1 : random.range(1, 48);
+	return Box(x, y, x + w, y + h);
+}
+
+enum {
+	VALUES_RANDOM,  // anything in [0, 1)
+	VALUES_LEVELS,  // sixteen levels in [0, 1]
+	VALUES_BINARY,  // blobs of 0 and 1
+	VALUES_MASK,    // blocks of -0.5 to 2.5
+	VALUES_SIXTEENTHS  // blocks of odd sixteenths, some 0 or less
+};
+
+/*! Fills a plane. The blocky kinds give runs of equal values, so windows
+ * and warps see ties and flat areas as well as noise.
+ */
+static void fill(Plane& plane, int kind, Random& random, float lo = 0.0f, float hi = 1.0f)
+{
+	const int block = random.range(1, 8);
+	std::vector<float> blocks(((plane.r - plane.x) / block + 2) * ((plane.t - plane.y) / block + 2));
+	for (size_t i=0; i < blocks.size(); i++){
+		switch (kind){
+		case VALUES_BINARY:
+			blocks[i] = random.chance(0.5f) ? 1.0f : 0.0f;
+			break;
+		case VALUES_MASK:
+			blocks[i] = random.chance(0.2f) ? 0.0f : random.uniform(-0.5f, 2.5f);
+			break;
+		case VALUES_SIXTEENTHS:
+			blocks[i] = random.chance(0.2f) ? -0.5f : (2 * random.range(0, 19) + 1) / 16.0f;
+			break;
+		default:
+			blocks[i] = random.uniform(lo, hi);
+		}
+	}
+	const int stride = (plane.r - plane.x) / block + 2;
+	for (int Y = plane.y; Y < plane.t; Y++){
+		for (int X = plane.x; X < plane.r; X++){
+			float& v = plane.at(X, Y);
+			if (kind == VALUES_RANDOM)
+				v = random.uniform(lo, hi);
+			else if (kind == VALUES_LEVELS)
+				v = random.range(0, 15) / 15.0f;
+			else
+				v = blocks[((Y - plane.y) / block) * stride + (X - plane.x) / block];
+		}
+	}
+}
+
+/*! Serves planes made up front, over a box of its own. Each source hashes
+ * differently, so nothing one case caches is seen by the next.
+ */
+class Source : public Iop {
+	Box _box;
+	Box _format;
+	std::vector<Plane> _planes;
+	ChannelSet _channels;
+	int _serial;
+
+public:
+	Source(const Box& box) : Iop(0), _box(box), _format(box), _planes(Chan_Last)
+	{
+		static int serial = 0;
+		_serial = ++serial;
+		inputs(0);
+	}
+
+	const char* Class() const { return "nkGoldenSource"; }
+	int minimum_inputs() const { return 0; }
+	int maximum_inputs() const { return 0; }
+
+	const Box& box() const { return _box; }
+	//! Makes the format format rather than the bbox, as with overscan.
+	void setFormat(const Box& format) { _format = format; }
+
+	//! The plane of z, made black if the source had no z yet.
+	Plane& plane(Channel z)
+	{
+		if (!_channels.contains(z)){
+			_channels += z;
+			_planes[z] = Plane(_box.x(), _box.y(), _box.r(), _box.t());
+		}
+		return _planes[z];
+	}
+	const Plane* find(Channel z) const { return _channels.contains(z) ? &_planes[z] : 0; }
+	//! The plane of z, or a black one if the source has no z.
+	Plane planeOrBlack(Channel z) const
+	{
+		return find(z) ? _planes[z] : Plane(_box.x(), _box.y(), _box.r(), _box.t());
+	}
+
+	void append(Hash& hash) { hash.append(_serial); }
+
+	void _validate(bool)
+	{
+		Format format(_format.w(), _format.h());
+		format.set(_format.x(), _format.y(), _format.r(), _format.t());
+		info_.format(format);
+		info_.full_size_format(format);
+		info_.set(_box);
+		info_.channels(_channels);
+	}
+
+	void engine(int y, int x, int r, ChannelMask channels, Row& row)
+	{
+		foreach (z, channels){
+			float* out = row.writable(z);
+			for (int X=x; X < r; X++)
+				out[X] = _planes[z].at(X, y);
+		}
+	}
+};
+
+/*! Builds a node the way a script would, with the context's view. The ops
+ * of each view of one node share it.
+ */
+static Iop* build(const char* node, Iop* input, int view = 1, Node* shared = 0)
+{
+	Iop* op = static_cast<Iop*>(Op::Description::find(node)->build(shared));
+	OutputContext context;
+	context.setView(view);
+	op->setOutputContext(context);
+	if (input)
+		op->set_input(0, input);
+	return op;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// checks
+
+static int checks = 0;
+static int failures = 0;
+
+static bool check(bool ok, const std::string& what)
+{
+	checks++;
+	if (!ok){
+		failures++;
+		printf("  FAILED %s\n", what.c_str());
+	}
+	return ok;
+}
+
+static void knob(Op* op, const char* name, const std::string& script)
+{
+	Knob* k = op->knob(name);
+	check(k && k->from_script(script.c_str()), format("knob %s %s", name, script.c_str()));
+}
+
+//! Units in the last place between two finite floats.
+static int64_t ulps(float a, float b)
+{
+	union { float f; int32_t i; } ua, ub;
+	ua.f = a;
+	ub.f = b;
+	const int64_t ia = ua.i < 0 ? int64_t(INT32_MIN) - ua.i : ua.i;
+	const int64_t ib = ub.i < 0 ? int64_t(INT32_MIN) - ub.i : ub.i;
+	return ia > ib ? ia - ib : ib - ia;
+}
+
+/*! Compares got against want over want's box, to within ulp units in the
+ * last place or tolerance. Pixels want has NaN for are not checked.
+ */
+static bool compare(const Plane& got, const Plane& want, int ulp, float tolerance, const std::string& what)
+{
+	int bad = 0;
+	std::string first;
+	for (int Y = want.y; Y < want.t; Y++){
+		for (int X = want.x; X < want.r; X++){
+			const float w = want.at(X, Y);
+			const float g = got.at(X, Y);
+			if (w != w || g == w || fabsf(g - w) <= tolerance || (g == g && ulps(g, w) <= ulp))
+				continue;
+			if (!bad++)
+				first = format(" first at %d,%d: %.9g, want %.9g", X, Y, g, w);
+		}
+	}
+	return check(!bad, format("%s: %d pixels differ%s", what.c_str(), bad, first.c_str()));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// rendering
+
+enum {
+	RENDER_ROWS,     // whole rows in order
+	RENDER_THREADS,  // whole rows handed out to threads, as Nuke does
+	RENDER_SPANS,    // random pieces of rows, bottom to top
+	RENDER_CROWD     // whole rows handed out to more threads than a band has rows
+};
+static const char* const RENDERS[] = { "rows", "threads", "spans", "crowd" };
+
+struct RenderJob {
+	Iop* op;
+	ChannelSet channels;
+	std::vector<Plane>* planes;
+	volatile int next;
+};
+
+static void renderThread(unsigned, unsigned, void* data)
+{
+	RenderJob& job = *static_cast<RenderJob*>(data);
+	const Plane& first = (*job.planes)[0];
+	Row row(first.x, first.r);
+	for (;;){
+		const int y = first.y + __sync_fetch_and_add(&job.next, 1);
+		if (y >= first.t)
+			break;
+		job.op->get(y, first.x, first.r, job.channels, row);
+		int c = 0;
+		foreach (z, job.channels){
+			Plane& plane = (*job.planes)[c++];
+			for (int X = plane.x; X < plane.r; X++)
+				plane.at(X, y) = row[z][X];
+		}
+	}
+}
+
+/*! Validates op and renders channels over its bbox, one plane per
+ * channel in order. With late set, only the first channel is requested
+ * and the others are asked for without one.
+ */
+static std::vector<Plane> render(Iop* op, const ChannelSet& channels, int how, Random& random, bool late = false)
+{
+	op->validate(true);
+	const Box box = op->info();
+	std::vector<Plane> planes(channels.size(), Plane(box.x(), box.y(), box.r(), box.t()));
+	if (box.w() <= 0 || box.h() <= 0)
+		return planes;
+	op->request(box.x(), box.y(), box.r(), box.t(), late ? ChannelSet(channels.first()) : channels, 1);
+
+	if (how == RENDER_THREADS || how == RENDER_CROWD){
+		RenderJob job;
+		job.op = op;
+		job.channels = channels;
+		job.planes = &planes;
+		job.next = 0;
+		Thread::spawn(renderThread, how == RENDER_CROWD ? 48 : 3, &job);
+		Thread::wait(&job);
+		return planes;
+	}
+
+	for (int i = 0; i < box.h(); i++){
+		const int y = how == RENDER_SPANS ? box.t() - 1 - i : box.y() + i;
+		int x = box.x();
+		while (x < box.r()){
+			const int r = how == RENDER_SPANS ? std::min(box.r(), x + random.range(1, 24)) : box.r();
+			Row row(x, r);
+			op->get(y, x, r, channels, row);
+			int c = 0;
+			foreach (z, channels){
+				for (int X = x; X < r; X++)
+					planes[c].at(X, y) = row[z][X];
+				c++;
+			}
+			x = r;
+		}
+	}
+	return planes;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// DrivenDilate
+
+/*! The box and round shapes on every path: rows streamed or not, the
+ * planar engine, binary channels, negative and zero sizes, masks above 1
+ * and below 0, a missing mask and a channel the input doesn't have. The
+ * round shape is exact up to its levels, and within one of its steps past
+ * them. Its radii are exact whatever the levels, as the mask has more
+ * distinct values than any levels tried.
+ */
+static void testDilate(Random& random, bool round)
+{
+	Source source(randomBox(random));
+	const int values = round ? (random.chance(0.3f) ? VALUES_RANDOM : VALUES_LEVELS) : random.range(0, 2);
+	for (Channel z = Chan_Red; z <= Chan_Alpha; z = Channel(z + 1))
+		fill(source.plane(z), values, random);
+	const bool hasMask = random.chance(0.85f);
+	if (hasMask)
+		fill(source.plane(Chan_Mask), round ? VALUES_SIXTEENTHS : VALUES_MASK, random);
+
+	// the round shape's reach is exact unless the ellipse can pass
+	// through a pixel centre, which odd sixteenths avoid unless h * v is a
+	// multiple of 16
+	float w, h;
+	do {
+		w = random.range(-6, 6) + (random.chance(0.3f) ? random.uniform(-0.45f, 0.45f) : 0.0f);
+		h = random.range(-6, 6) + (random.chance(0.3f) ? random.uniform(-0.45f, 0.45f) : 0.0f);
+	} while (round && int(fabsf(w) + .5f) * int(fabsf(h) + .5f) % 16 == 0 &&
+		int(fabsf(w) + .5f) * int(fabsf(h) + .5f) != 0);
+	const int hSize = int(fabsf(w) + .5f);
+	const int vSize = int(fabsf(h) + .5f);
+	const bool streamRows = random.chance(0.5f);
+	const bool planar = random.chance(0.3f);
+	const int binary = random.range(0, 2);
+	const int bbox = random.chance(0.2f) ? random.range(1, 3) : 0;
+	const int how = random.range(0, 3);
+	const int levels = random.chance(0.3f) ? random.range(2, 8) : 16;
+
+	// now and then the bbox overscans the format, mask and all
+	const Box& all = source.box();
+	Box formatBox = all;
+	const bool overscan = random.chance(0.3f);
+	if (overscan){
+		const int x = random.range(all.x(), all.r() - 1);
+		const int y = random.range(all.y(), all.t() - 1);
+		formatBox = Box(x, y, random.range(x + 1, all.r()), random.range(y + 1, all.t()));
+		source.setFormat(formatBox);
+	}
+
+	Iop* op = build("DrivenDilate", &source);
+	knob(op, "maskChannel", format("%d", (int)Chan_Mask));
+	knob(op, "size", format("%.9g %.9g", w, h));
+	knob(op, "shape", round ? "1" : "0");
+	knob(op, "levels", format("%d", levels));
+	knob(op, "streamRows", streamRows ? "1" : "0");
+	knob(op, "planar", planar ? "1" : "0");
+	knob(op, "binary", format("%d", binary));
+	knob(op, "bbox", format("%d", bbox));
+
+	ChannelSet channels(Mask_RGBA);
+	channels += Chan_Z;
+	// the planar engines build the channels requested first, so now and
+	// then the rest are only asked for afterwards
+	const bool late = random.chance(0.2f);
+	const std::string what = format("DrivenDilate %s size %g %g levels %d values %d mask %d stream %d planar %d binary %d bbox %d overscan %d late %d %s",
+		round ? "round" : "box", w, h, levels, values, hasMask, streamRows, planar, binary, bbox, overscan, late, RENDERS[how]);
+
+	// now and then the op renders a frame with no mask first, whose pyramid
+	// mustn't shrink the bbox of this one below a new op's
+	if (hasMask && random.chance(0.3f)){
+		Source before(all);
+		before.setFormat(formatBox);
+		for (Channel z = Chan_Red; z <= Chan_Alpha; z = Channel(z + 1))
+			before.plane(z) = *source.find(z);
+		before.plane(Chan_Mask);
+		op->set_input(0, &before);
+		render(op, channels, RENDER_ROWS, random);
+		op->set_input(0, &source);
+		op->validate(true);
+		const Box after = op->info();
+
+		Iop* fresh = build("DrivenDilate", &source);
+		knob(fresh, "maskChannel", format("%d", (int)Chan_Mask));
+		knob(fresh, "size", format("%.9g %.9g", w, h));
+		knob(fresh, "shape", round ? "1" : "0");
+		knob(fresh, "levels", format("%d", levels));
+		knob(fresh, "bbox", format("%d", bbox));
+		fresh->validate(true);
+		const Box first = fresh->info();
+		check(after.x() <= first.x() && after.y() <= first.y() && after.r() >= first.r() && after.t() >= first.t(),
+			what + format(" bbox after a frame with no mask %d %d %d %d, not around %d %d %d %d",
+				after.x(), after.y(), after.r(), after.t(), first.x(), first.y(), first.r(), first.t()));
+		delete fresh;
+	}
+
+	const std::vector<Plane> got = render(op, channels, how, random, late);
+	const Box box = op->info();
+	check(!op->errorMessage(), what + " error");
+
+	int c = 0;
+	foreach (z, channels){
+		// more values than the round shape's levels are quantised to that
+		// many steps across their range
+		float step = 0.0f;
+		if (round && (values == VALUES_RANDOM || levels < 16) && source.find(z)){
+			const std::vector<float>& p = source.find(z)->pixels;
+			step = (*std::max_element(p.begin(), p.end()) - *std::min_element(p.begin(), p.end())) / levels;
+		}
+		Plane want;
+		if (z == Chan_Z)
+			want = Plane(box.x(), box.y(), box.r(), box.t());
+		else if (round)
+			want = referenceDilateRound(*source.find(z), source.find(Chan_Mask),
+				box.x(), box.y(), box.r(), box.t(), hSize, vSize, w < 0);
+		else
+			want = referenceDilateBox(*source.find(z), source.find(Chan_Mask),
+				box.x(), box.y(), box.r(), box.t(), hSize, vSize, w < 0, h < 0);
+		if (!round && binary == 2){
+			for (size_t p=0; p < want.pixels.size(); p++)
+				want.pixels[p] = want.pixels[p] > 0.5f ? 1.0f : 0.0f;
+		}
+		compare(got[c], want, 0, step * 1.0001f, what + " " + getName(z));
+
+		// the baseline's loops agree wherever it defined a result, unless
+		// the mask drives both passes, or binary on, the round shape or
+		// overscan are in play
+		if (!round && binary != 2 && !overscan && !(hSize && vSize)){
+			float maxValue = 0.0f;
+			for (int Y = formatBox.y(); hasMask && Y < formatBox.t(); Y++)
+				for (int X = formatBox.x(); X < formatBox.r(); X++)
+					maxValue = std::max(fabsf(source.find(Chan_Mask)->edge(X, Y)), maxValue);
+			const Plane black(all.x(), all.y(), all.r(), all.t());
+			compare(got[c], baselineDilateBox(source.find(z) ? *source.find(z) : black, source.find(Chan_Mask),
+				box.x(), box.y(), box.r(), box.t(), w, h, bbox, maxValue), 0, 0.0f, what + " " + getName(z) + " baseline");
+		}
+		c++;
+	}
+
+	delete op;
+}
+
+static void testDilateBox(Random& random) { testDilate(random, false); }
+static void testDilateRound(Random& random) { testDilate(random, true); }
+
+//////////////////////////////////////////////////////////////////////////////
+// DisparityDistort
+
+static const Channel DISPARITY[4] = {
+	Chan_Stereo_Disp_Left_X, Chan_Stereo_Disp_Left_Y, Chan_Stereo_Disp_Right_X, Chan_Stereo_Disp_Right_Y
+};
+
+/*! A source with disparity in steps of an eighth, in blocks, so pixels
+ * land on each other, and now and then without its Y or any disparity.
+ */
+static Source* warpSource(Random& random, int& disparity)
+{
+	Source* source = new Source(randomBox(random));
+	for (Channel z = Chan_Red; z <= Chan_Alpha; z = Channel(z + 1))
+		fill(source->plane(z), VALUES_RANDOM, random);
+	disparity = random.chance(0.1f) ? 0 : random.chance(0.2f) ? 1 : 2;
+	for (int i=0; i < 4; i++){
+		if ((i & 1) ? disparity < 2 : disparity < 1)
+			continue;
+		Plane& plane = source->plane(DISPARITY[i]);
+		fill(plane, random.chance(0.5f) ? VALUES_MASK : VALUES_RANDOM, random, -6.0f, 6.0f);
+		for (size_t p=0; p < plane.pixels.size(); p++)
+			plane.pixels[p] = floorf(plane.pixels[p] * ((i & 1) ? 1.0f : 3.0f) * 8.0f) / 8.0f + 0.0f;
+	}
+	return source;
+}
+
+/*! The expected planes of a warp of source's rgba into box, for the left
+ * or right view.
+ */
+static std::vector<Plane> referenceWarp(const Source& source, const Box& box, bool left, bool useY,
+	bool backward, bool bilinear)
+{
+	const Plane dispX = source.planeOrBlack(DISPARITY[left ? 0 : 2]);
+	const Plane* dispY = useY ? source.find(DISPARITY[left ? 1 : 3]) : 0;
+	std::vector<Plane> planes;
+	if (!backward){
+		for (Channel z = Chan_Red; z <= Chan_Alpha; z = Channel(z + 1))
+			planes.push_back(referenceForward(*source.find(z), dispX, dispY, left,
+				box.x(), box.y(), box.r(), box.t(), 0.0f));
+		return planes;
+	}
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const Plane invX = referenceForward(dispX, dispX, dispY, left, box.x(), box.y(), box.r(), box.t(), nan);
+	const Plane invY = referenceForward(dispY ? *dispY : dispX, dispX, dispY, left,
+		box.x(), box.y(), box.r(), box.t(), nan);
+	for (Channel z = Chan_Red; z <= Chan_Alpha; z = Channel(z + 1))
+		planes.push_back(referenceBackward(*source.find(z), invX, invY, dispY != 0, bilinear));
+	return planes;
+}
+
+//! A copy of source with other colours and the same disparity.
+static Source* recolored(const Source& source, Random& random)
+{
+	Source* copy = new Source(source.box());
+	for (Channel z = Chan_Red; z <= Chan_Alpha; z = Channel(z + 1))
+		fill(copy->plane(z), VALUES_RANDOM, random);
+	for (int i=0; i < 4; i++){
+		if (source.find(DISPARITY[i]))
+			copy->plane(DISPARITY[i]) = *source.find(DISPARITY[i]);
+	}
+	return copy;
+}
+
+/*! Forward and backward warps of each view, row by row and planar, with
+ * both views made in one pass and shared between the ops of the node, but
+ * not with another node rendering in between, nor once the second view's
+ * input has been edited since.
+ */
+static void testWarp(Random& random)
+{
+	int disparity;
+	Source* source = warpSource(random, disparity);
+	const int view = random.range(0, 2);
+	const bool backward = random.chance(0.4f);
+	const bool bilinear = random.chance(0.5f);
+	const bool planar = random.chance(0.5f);
+	const int how = random.range(0, 2);
+	const bool again = random.chance(0.5f);
+	const bool edit = view == VIEW_BOTH && random.chance(0.5f);
+	// the planar pass pushes the channels requested first, so now and
+	// then the rest are only asked for afterwards
+	const bool late = random.chance(0.2f);
+
+	// both views are two ops of one node, one per view of the script, and
+	// as in Nuke both are validated before either renders
+	Node node, otherNode;
+	std::vector<Iop*> ops;
+	for (int v = 1; v <= (view == VIEW_BOTH ? 2 : 1); v++){
+		Iop* op = build("DisparityDistort", source, v, &node);
+		ops.push_back(op);
+		knob(op, "view", format("%d", view));
+		knob(op, "warp", backward ? "1" : "0");
+		knob(op, "filter", bilinear ? "1" : "0");
+		knob(op, "planar", planar ? "1" : "0");
+		op->validate();
+	}
+	Source* edited = 0;
+	for (int v = 1; v <= (int)ops.size(); v++){
+		Iop* op = ops[v - 1];
+		Source* input = source;
+		if (v == 2){
+			// the other node pushes other colours along the same disparity
+			Source* otherSource = recolored(*source, random);
+			Iop* other = build("DisparityDistort", otherSource, 1, &otherNode);
+			knob(other, "view", format("%d", VIEW_BOTH));
+			knob(other, "planar", planar ? "1" : "0");
+			render(other, Mask_RGBA, RENDER_ROWS, random);
+			delete other;
+			delete otherSource;
+			if (edit){
+				input = edited = recolored(*source, random);
+				op->set_input(0, input);
+				op->invalidate();
+			}
+		}
+
+		// the bbox only grows by the disparity once a render has found its
+		// range, as it does in Nuke from the second validate on
+		if (again){
+			render(op, Mask_RGBA, RENDER_ROWS, random);
+			op->invalidate();
+		}
+		const std::vector<Plane> got = render(op, Mask_RGBA, how, random, late);
+		const bool left = view == VIEW_LEFT || (view == VIEW_BOTH && v == 1);
+		const std::string what = format("DisparityDistort %s view %d of %d %s %s planar %d disparity %d again %d edit %d late %d %s",
+			backward ? "backward" : "forward", view, v, left ? "left" : "right",
+			bilinear ? "bilinear" : "nearest", planar, disparity, again, edit, late, RENDERS[how]);
+		check(!op->errorMessage(), what + " error");
+		const std::vector<Plane> want = referenceWarp(*input, op->info(), left,
+			planar || backward, backward, bilinear);
+		for (int c=0; c < 4; c++){
+			const Channel z = Channel(Chan_Red + c);
+			compare(got[c], want[c], backward ? 2 : 0, backward ? 1e-6f : 0.0f, what + " " + getName(z));
+			// the baseline copied the input through, as the warp does
+			// without any disparity
+			if (!disparity){
+				const Box& box = op->info();
+				compare(got[c], baselineDistort(*input->find(z), 0.0f, box.x(), box.y(), box.r(), box.t()),
+					0, 0.0f, what + " " + getName(z) + " baseline");
+			}
+		}
+	}
+	for (size_t i=0; i < ops.size(); i++)
+		delete ops[i];
+	delete edited;
+	delete source;
+}
+
+/*! The fill keeps what the forward warp pushed and fills the holes with
+ * values between the least and greatest of it.
+ */
+static void testWarpFill(Random& random)
+{
+	int disparity;
+	Source* source = warpSource(random, disparity);
+	const bool left = random.chance(0.5f);
+	const bool planar = random.chance(0.5f);
+
+	Iop* op = build("DisparityDistort", source);
+	knob(op, "view", left ? "0" : "1");
+	knob(op, "planar", planar ? "1" : "0");
+	knob(op, "fill", "1");
+	const std::vector<Plane> got = render(op, Mask_RGBA, RENDER_ROWS, random);
+	const Box box = op->info();
+	const std::string what = format("DisparityDistort fill %s planar %d disparity %d",
+		left ? "left" : "right", planar, disparity);
+	check(!op->errorMessage(), what + " error");
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const Plane dispX = source->planeOrBlack(DISPARITY[left ? 0 : 2]);
+	const Plane* dispY = planar ? source->find(DISPARITY[left ? 1 : 3]) : 0;
+	for (int c=0; c < 4; c++){
+		const Channel z = Channel(Chan_Red + c);
+		const Plane want = referenceForward(*source->find(z), dispX, dispY, left,
+			box.x(), box.y(), box.r(), box.t(), nan);
+		compare(got[c], want, 0, 0.0f, what + " " + getName(z) + " covered");
+		float lo = std::numeric_limits<float>::max(), hi = -lo;
+		for (size_t p=0; p < want.pixels.size(); p++){
+			if (want.pixels[p] == want.pixels[p]){
+				lo = std::min(lo, want.pixels[p]);
+				hi = std::max(hi, want.pixels[p]);
+			}
+		}
+		if (lo > hi)
+			lo = hi = 0.0f;
+		int bad = 0;
+		for (size_t p=0; p < want.pixels.size(); p++){
+			const float g = got[c].pixels[p];
+			if (want.pixels[p] != want.pixels[p] && !(g >= lo - 1e-5f && g <= hi + 1e-5f))
+				bad++;
+		}
+		check(!bad, format("%s %s: %d holes outside [%g, %g]", what.c_str(), getName(z), bad, lo, hi));
+	}
+	delete op;
+	delete source;
+}
+
+/*! The backward warp with the fill samples along an inverse disparity
+ * with its holes filled, which can point anywhere, off the input too.
+ */
+static void testWarpFillBackward(Random& random)
+{
+	int disparity;
+	Source* source = warpSource(random, disparity);
+	const bool left = random.chance(0.5f);
+	const bool bilinear = random.chance(0.5f);
+	const int how = random.range(0, 2);
+
+	Iop* op = build("DisparityDistort", source);
+	knob(op, "view", left ? "0" : "1");
+	knob(op, "warp", "1");
+	knob(op, "filter", bilinear ? "1" : "0");
+	knob(op, "fill", "1");
+	render(op, Mask_RGBA, RENDER_ROWS, random);
+	op->invalidate();
+	const std::vector<Plane> got = render(op, Mask_RGBA, how, random);
+	const Box box = op->info();
+	const std::string what = format("DisparityDistort fill backward %s %s disparity %d %s",
+		left ? "left" : "right", bilinear ? "bilinear" : "nearest", disparity, RENDERS[how]);
+	check(!op->errorMessage(), what + " error");
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const Plane dispX = source->planeOrBlack(DISPARITY[left ? 0 : 2]);
+	const Plane* dispY = source->find(DISPARITY[left ? 1 : 3]);
+	Plane invX = referenceForward(dispX, dispX, dispY, left, box.x(), box.y(), box.r(), box.t(), nan);
+	Plane invY = referenceForward(dispY ? *dispY : Plane(dispX.x, dispX.y, dispX.r, dispX.t), dispX, dispY, left,
+		box.x(), box.y(), box.r(), box.t(), nan);
+	std::vector<float> coverage(invX.pixels.size());
+	for (size_t p=0; p < coverage.size(); p++)
+		coverage[p] = invX.pixels[p] == invX.pixels[p] ? 1.0f : 0.0f;
+	if (!coverage.empty()){
+		float* planes[2] = { &invX.pixels[0], &invY.pixels[0] };
+		pushPull(planes, 2, &coverage[0], box.w(), box.h());
+	}
+	for (int c=0; c < 4; c++){
+		const Channel z = Channel(Chan_Red + c);
+		compare(got[c], referenceBackward(*source->find(z), invX, invY, dispY != 0, bilinear),
+			2, 1e-6f, what + " " + getName(z));
+	}
+	delete op;
+	delete source;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Ramp2
+
+static const CurveDescription CURVES[] = {
+	{ "master", "y C 0 1" },
+	{ "red", "y C 0 1" },
+	{ "green", "y C 0 1" },
+	{ "blue", "y C 0 1" },
+	{ "alpha", "y C 0 1" },
+	{ 0 }
+};
+
+//! A Ramp2 over box with the settings of s and the curves of its lut.
+static Iop* buildRamp(const Box& box, const RampSettings& s, const std::string& curves)
+{
+	Iop* op = build("Ramp2", 0);
+	knob(op, "format", format("%d %d %d %d %d %d", box.w(), box.h(), box.x(), box.y(), box.r(), box.t()));
+	knob(op, "p0", format("%.9g %.9g", s.p0[0], s.p0[1]));
+	knob(op, "p1", format("%.9g %.9g", s.p1[0], s.p1[1]));
+	knob(op, "col0", format("%.9g %.9g %.9g %.9g", s.low[0], s.low[1], s.low[2], s.low[3]));
+	knob(op, "col1", format("%.9g %.9g %.9g %.9g", s.high[0], s.high[1], s.high[2], s.high[3]));
+	knob(op, "mode", format("%d", s.mode));
+	knob(op, "stops", format("%d", s.stops));
+	for (int i=0; i < 6; i++){
+		knob(op, format("stop%d", i + 1).c_str(), format("%.9g", s.stopPos[i]));
+		knob(op, format("stop%d_col", i + 1).c_str(), format("%.9g %.9g %.9g %.9g",
+			s.stopCol[i][0], s.stopCol[i][1], s.stopCol[i][2], s.stopCol[i][3]));
+	}
+	knob(op, "lut", curves);
+	knob(op, "enable", s.lut ? "1" : "0");
+	return op;
+}
+
+/*! Every mode, with and without stops and the lut, over formats off the
+ * origin and points outside them. Ops with the same knobs follow, as for
+ * other frames, the second one filling the cached plane and the third
+ * reading it.
+ */
+static void testRamp(Random& random)
+{
+	const Box box = randomBox(random);
+	RampSettings s;
+	do {
+		for (int i=0; i < 2; i++){
+			s.p0[i] = random.uniform(-20.0f, 80.0f);
+			s.p1[i] = random.uniform(-20.0f, 80.0f);
+		}
+	} while (hypot(s.p1[0] - s.p0[0], s.p1[1] - s.p0[1]) < 16.0);
+	// a ramp of no length
+	if (random.chance(0.25f)){
+		s.p1[0] = s.p0[0];
+		s.p1[1] = s.p0[1];
+	}
+	s.mode = random.chance(0.4f) ? RampSettings::LINEAR : random.range(1, 2);
+	s.stops = random.chance(0.5f) ? 0 : random.range(1, 4);
+	for (int z=0; z < 4; z++){
+		const bool black = random.chance(0.15f);
+		s.low[z] = black ? 0.0f : random.uniform(-0.25f, 1.25f);
+		s.high[z] = black ? 0.0f : random.uniform(-0.25f, 1.25f);
+	}
+	for (int i=0; i < 6; i++){
+		s.stopPos[i] = random.uniform(-0.1f, 1.1f);
+		for (int z=0; z < 4; z++)
+			s.stopCol[i][z] = random.uniform(0.0f, 1.0f);
+	}
+	const bool lut = random.chance(0.4f);
+	std::string curves;
+	LookupCurves lookup(CURVES);
+	for (int i=0; i < 5; i++){
+		const std::string curve = random.chance(0.5f) ? std::string("y C 0 1") :
+			format("y C 0 x%.3f %.3f x1 1", random.uniform(0.2f, 0.8f), random.uniform(0.1f, 0.9f));
+		lookup.setCurve(i, curve.c_str());
+		curves += "{" + curve + "} ";
+	}
+	s.lut = lut ? &lookup : 0;
+	const int how = random.range(0, 2);
+
+	Iop* op = buildRamp(box, s, curves);
+	const std::vector<Plane> got = render(op, Mask_RGBA, how, random);
+	const Box bbox = op->info();
+	const std::string what = format("Ramp2 mode %d stops %d lut %d p0 %g %g p1 %g %g %s",
+		s.mode, s.stops, lut, s.p0[0], s.p0[1], s.p1[0], s.p1[1], RENDERS[how]);
+	check(!op->errorMessage(), what + " error");
+	delete op;
+
+	std::vector<Plane> gotAgain[2];
+	int howAgain[2];
+	for (int i=0; i < 2; i++){
+		howAgain[i] = random.range(0, 2);
+		Iop* again = buildRamp(box, s, curves);
+		gotAgain[i] = render(again, Mask_RGBA, howAgain[i], random);
+		check(!again->errorMessage(), what + " again error");
+		delete again;
+	}
+
+	// a plain linear ramp is worked out per pixel, the others come from a
+	// table of 4096 steps, good to what the curve moves in a step except
+	// within a step of where stops on top of each other jump
+	const bool table = lut || s.stops || s.mode != RampSettings::LINEAR;
+	std::vector<double> jumps;
+	for (int i=0; i < s.stops; i++){
+		const double p = std::min(std::max((double)s.stopPos[i], 0.0), 1.0);
+		bool jump = p == 0.0 || p == 1.0;
+		for (int j=0; j < s.stops; j++)
+			jump = jump || (j != i && std::min(std::max((double)s.stopPos[j], 0.0), 1.0) == p);
+		if (jump)
+			jumps.push_back(p);
+	}
+	for (int z=0; z < 4; z++){
+		float tolerance = 2e-5f;
+		for (int i=0; table && i < 4096; i++){
+			bool jump = false;
+			for (size_t j=0; j < jumps.size(); j++)
+				jump = jump || fabs(i / 4096.0 - jumps[j]) < 2.0 / 4096;
+			double lo = 1e30, hi = -1e30;
+			for (int k=0; !jump && k <= 4; k++){
+				const double v = referenceRampValue(s, z, (i + k / 4.0) / 4096.0);
+				lo = std::min(lo, v);
+				hi = std::max(hi, v);
+			}
+			if (!jump)
+				tolerance = std::max(tolerance, 2e-5f + float(hi - lo));
+		}
+		Plane want(bbox.x(), bbox.y(), bbox.r(), bbox.t());
+		for (int Y = bbox.y(); Y < bbox.t(); Y++){
+			for (int X = bbox.x(); X < bbox.r(); X++){
+				const double t = referenceRampPosition(s, X, Y);
+				// the angular ramp jumps from 1 to 0 across p1's side
+				bool skip = s.mode == RampSettings::ANGULAR && (t < 1e-4 || t > 1 - 1e-4);
+				for (size_t i=0; i < jumps.size(); i++)
+					skip = skip || fabs(t - jumps[i]) < 1.5 / 4096;
+				want.at(X, Y) = skip ? std::numeric_limits<float>::quiet_NaN() : float(referenceRampValue(s, z, t));
+			}
+		}
+		compare(got[z], want, 0, tolerance, what + " " + getName(Channel(Chan_Red + z)));
+		for (int i=0; i < 2; i++)
+			compare(gotAgain[i][z], want, 0, tolerance, what + " " + getName(Channel(Chan_Red + z)) + " again " + RENDERS[howAgain[i]]);
+
+		// the baseline's linear ramp agrees, where it was defined
+		if (s.mode == RampSettings::LINEAR && !s.stops)
+			compare(got[z], baselineRamp(s.low, s.high, s.p0, s.p1, s.lut, z, bbox.x(), bbox.y(), bbox.r(), bbox.t()),
+				0, tolerance, what + " " + getName(Channel(Chan_Red + z)) + " baseline");
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// kernels
+
+//! The sparse tables against every window up to their length.
+template <class Op>
+static void testTables(Random& random, bool dilate)
+{
+	const int count = random.range(1, 300);
+	const int maxLength = random.range(1, count);
+	const std::string what = format("%s tables count %d length %d", dilate ? "max" : "min", count, maxLength);
+
+	MinMaxTable<Op> table;
+	std::vector<float> values(4 * count);
+	__m128* entries = table.reset(count, maxLength);
+	for (int i=0; i < count; i++){
+		for (int c=0; c < 4; c++)
+			values[4 * i + c] = random.chance(0.2f) ? 0.5f : random.uniform(-1.0f, 1.0f);
+		entries[i] = _mm_loadu_ps(&values[4 * i]);
+	}
+	table.build();
+
+	MinMaxTable<Op, true> words;
+	std::vector<uint64_t> bits(count);
+	uint64_t* wordEntries = words.reset(count, maxLength);
+	for (int i=0; i < count; i++)
+		wordEntries[i] = bits[i] = ((uint64_t)random.next() << 32 | random.next()) & ((uint64_t)random.next() << 32 | random.next());
+	words.build();
+
+	BitRowTable<Op> row;
+	uint64_t* rowBits = row.reset(count, maxLength);
+	std::vector<bool> flags(count);
+	for (int i=0; i < count; i++){
+		flags[i] = random.chance(dilate ? 0.1f : 0.9f);
+		if (flags[i])
+			rowBits[i >> 6] |= (uint64_t)1 << (i & 63);
+	}
+	row.build();
+
+	int bad = 0;
+	for (int l=0; l < count; l++){
+		for (int r = l + 1; r <= std::min(count, l + maxLength); r++){
+			float want[4], got[4];
+			_mm_storeu_ps(got, table.query(l, r));
+			uint64_t wantWord = bits[l];
+			bool wantFlag = flags[l];
+			for (int c=0; c < 4; c++)
+				want[c] = values[4 * l + c];
+			for (int i = l + 1; i < r; i++){
+				for (int c=0; c < 4; c++)
+					want[c] = Op::apply(want[c], values[4 * i + c]);
+				wantWord = Op::apply(wantWord, bits[i]);
+				wantFlag = Op::apply((uint64_t)wantFlag, (uint64_t)flags[i]) != 0;
+			}
+			bad += memcmp(want, got, sizeof(want)) != 0;
+			bad += words.query(l, r) != wantWord;
+			bad += row.query(l, r) != wantFlag;
+		}
+	}
+	check(!bad, format("%s: %d queries differ", what.c_str(), bad));
+}
+
+static void testTables(Random& random)
+{
+	testTables<MinOp>(random, false);
+	testTables<MaxOp>(random, true);
+}
+
+//! Packing against the per value rules, binary and not.
+static void testPackBits(Random& random)
+{
+	const int n = random.range(1, 200);
+	const bool binary = random.chance(0.7f);
+	const bool threshold = random.chance(0.5f);
+	std::vector<float> values(n);
+	for (int i=0; i < n; i++)
+		values[i] = binary || random.chance(0.9f) ? float(random.range(0, 1)) : random.uniform(0.0f, 1.0f);
+
+	std::vector<uint64_t> bits((n + 63) / 64, ~(uint64_t)0);
+	const bool packed = packBits(&values[0], n, &bits[0], threshold);
+	bool wantPacked = true;
+	int bad = 0;
+	for (int i=0; i < n; i++){
+		const float v = values[i];
+		wantPacked = wantPacked && (threshold || v == 0.0f || v == 1.0f);
+		if (packed)
+			bad += (((bits[i >> 6] >> (i & 63)) & 1) != 0) != (threshold ? v > 0.5f : v == 1.0f);
+	}
+	check(packed == wantPacked && !bad, format("packBits n %d threshold %d: packed %d, %d bits differ",
+		n, threshold, packed, bad));
+}
+
+//! Windows along a line against the plain loop, in place or not.
+static void testWindowLine(Random& random)
+{
+	const int count = random.range(1, 200);
+	const int n = random.range(1, 4);
+	const int maxLength = random.range(1, 2 * count);
+	const bool inPlace = random.chance(0.5f);
+	std::vector<float> src(4 * count), dst(4 * count);
+	std::vector<int> starts(count), ends(count);
+	for (int i=0; i < 4 * count; i++)
+		src[i] = random.uniform(-1.0f, 1.0f);
+	for (int i=0; i < count; i++){
+		starts[i] = random.range(0, count - 1);
+		ends[i] = std::min(count, starts[i] + random.range(-2, std::min(maxLength, count)));
+	}
+	const std::vector<float> original(src);
+
+	const float* from[4];
+	float* to[4];
+	for (int c=0; c < 4; c++){
+		from[c] = &src[c * count];
+		to[c] = inPlace ? &src[c * count] : &dst[c * count];
+	}
+	MinMaxTable<MaxOp> table;
+	windowLine(from, to, n, count, &starts[0], &ends[0], maxLength, table);
+
+	int bad = 0;
+	for (int c=0; c < n; c++){
+		for (int i=0; i < count; i++){
+			float want = original[c * count + i];
+			for (int j = starts[i]; j < ends[i]; j++)
+				want = std::max(want, original[c * count + j]);
+			bad += to[c][i] != want;
+		}
+	}
+	check(!bad, format("windowLine count %d n %d in place %d: %d pixels differ", count, n, inPlace, bad));
+}
+
+static void testTranspose(Random& random)
+{
+	const int width = random.range(1, 150);
+	const int height = random.range(1, 150);
+	std::vector<float> src((size_t)width * height), dst(src.size(), -1.0f);
+	for (size_t i=0; i < src.size(); i++)
+		src[i] = float(i);
+	for (int ty=0; ty < height; ty += PLANE_TILE)
+		for (int tx=0; tx < width; tx += PLANE_TILE)
+			transposeTile(&src[0], &dst[0], width, height, tx, ty);
+	int bad = 0;
+	for (int y=0; y < height; y++)
+		for (int x=0; x < width; x++)
+			bad += dst[(size_t)x * height + y] != src[(size_t)y * width + x];
+	check(!bad, format("transposeTile %dx%d: %d pixels differ", width, height, bad));
+}
+
+//! The lower envelope against the minimum over every sample.
+static void testDistanceTransform(Random& random)
+{
+	const int n = random.range(1, 120);
+	const int radius = random.range(0, 8);
+	const double weight = radius ? 1.0 / (radius * radius) : 0.0;
+	const float far = random.chance(0.1f) ? 1.0f : random.uniform(0.0f, 0.9f);
+	std::vector<float> f(n), d(n);
+	std::vector<int> v(n);
+	std::vector<double> z(n + 1);
+	for (int i=0; i < n; i++)
+		f[i] = random.chance(far) ? FAR_AWAY : random.chance(0.5f) ? 0.0f : random.uniform(0.0f, 4.0f);
+	distanceTransform(&f[0], &d[0], n, weight, &v[0], &z[0]);
+
+	int bad = 0;
+	for (int p=0; p < n; p++){
+		double want = FAR_AWAY;
+		for (int q=0; q < n; q++){
+			if (f[q] < FAR_AWAY && (weight > 0 || q == p))
+				want = std::min(want, weight * (p - q) * (p - q) + f[q]);
+		}
+		bad += fabs(d[p] - want) > 1e-6 * std::max(1.0, want);
+	}
+	check(!bad, format("distanceTransform n %d radius %d: %d samples differ", n, radius, bad));
+}
+
+//! The four wide ramp kernels against their plain loops.
+static void testRampKernels(Random& random)
+{
+	const int n = random.range(1, 300);
+	std::vector<float> got(n), want(n);
+	const float start = random.uniform(-2.0f, 2.0f);
+	const float step = random.uniform(-0.05f, 0.05f);
+	const float lo = random.uniform(-1.0f, 0.5f);
+	const float hi = lo + random.uniform(0.0f, 1.5f);
+	fillRamp(&got[0], n, start, step, lo, hi);
+	int bad = 0;
+	for (int i=0; i < n; i++)
+		bad += got[i] != std::min(std::max(start + i * step, lo), hi);
+	check(!bad, format("fillRamp n %d: %d values differ", n, bad));
+
+	// a NaN ramp clamps to lo in the vector lanes and the tail alike
+	fillRamp(&got[0], n, std::numeric_limits<float>::quiet_NaN(), step, lo, hi);
+	bad = 0;
+	for (int i=0; i < n; i++)
+		bad += got[i] != lo;
+	check(!bad, format("fillRamp n %d of NaN: %d values not lo", n, bad));
+
+	const float dx = random.uniform(-200.0f, 200.0f);
+	const float dy = random.uniform(-200.0f, 200.0f);
+	const float scale = 1.0f / random.uniform(16.0f, 300.0f);
+	fillRadial(&got[0], n, dx, dy, scale);
+	bad = 0;
+	for (int i=0; i < n; i++)
+		bad += fabs(got[i] - std::min(hypot(dx + i, (double)dy) * scale, 1.0)) > 1e-5;
+	check(!bad, format("fillRadial n %d: %d values differ", n, bad));
+
+	const double angle = random.uniform(-3.2f, 3.2f);
+	fillAngular(&got[0], n, dx, dy, angle);
+	bad = 0;
+	for (int i=0; i < n; i++){
+		double a = (atan2((double)dy, (double)(dx + i)) - angle) / (2 * M_PI);
+		a -= floor(a);
+		bad += fabs(got[i] - a) > 1e-6 && fabs(got[i] - a) < 1 - 1e-6;
+	}
+	check(!bad, format("fillAngular n %d: %d values differ", n, bad));
+
+	const int size = random.range(1, 64);
+	std::vector<float> table(size + 1), t(n);
+	for (int i=0; i <= size; i++)
+		table[i] = random.uniform(-1.0f, 1.0f);
+	for (int i=0; i < n; i++)
+		t[i] = random.chance(0.1f) ? float(random.range(0, 1)) : random.uniform(0.0f, 1.0f);
+	lookupTable(&t[0], n, &table[0], size, &got[0]);
+	bad = 0;
+	for (int i=0; i < n; i++){
+		const float f = t[i] * size;
+		const int j = std::min((int)f, size - 1);
+		bad += fabs(got[i] - (table[j] + (table[j + 1] - table[j]) * (f - j))) > 1e-6;
+	}
+	check(!bad, format("lookupTable n %d size %d: %d values differ", n, size, bad));
+
+	// positions outside clamp to the ends, NaN to 1
+	for (int i=0; i < n; i++)
+		t[i] = random.chance(0.3f) ? std::numeric_limits<float>::quiet_NaN() : random.uniform(-1e9f, 1e9f);
+	lookupTable(&t[0], n, &table[0], size, &got[0]);
+	bad = 0;
+	for (int i=0; i < n; i++)
+		bad += fabs(got[i] - (t[i] > 0.0f || t[i] != t[i] ? table[size] : table[0])) > 1e-6;
+	check(!bad, format("lookupTable n %d size %d out of range: %d values differ", n, size, bad));
+}
+
+static bool sameBits(const std::vector<float>& a, const std::vector<float>& b)
+{
+	return a.size() == b.size() && !memcmp(&a[0], &b[0], a.size() * sizeof(float));
+}
+
+//! Every build of the dispatched kernels the cpu runs gives sse2's bits.
+static void testIsas(Random& random)
+{
+	const int count = random.range(1, 300);
+	const int levels = MinMaxTable<MinOp>::log2Floor(random.range(1, count)) + 1;
+	const int n = random.range(1, 300);
+	const int size = random.range(1, 64);
+	std::vector<float> entries((size_t)4 * count * levels), t(n), table(size + 1), binary(n);
+	for (size_t i=0; i < entries.size(); i++)
+		entries[i] = random.chance(0.2f) ? 0.5f : random.uniform(-1.0f, 1.0f);
+	for (int i=0; i < n; i++){
+		t[i] = random.chance(0.1f) ? float(random.range(0, 1)) : random.uniform(0.0f, 1.0f);
+		binary[i] = random.chance(0.95f) ? float(random.range(0, 1)) : random.uniform(0.0f, 1.0f);
+	}
+	for (int i=0; i <= size; i++)
+		table[i] = random.uniform(-1.0f, 1.0f);
+	const float start = random.uniform(-2.0f, 2.0f);
+	const float step = random.uniform(-0.05f, 0.05f);
+	const float lo = random.uniform(-1.0f, 0.5f);
+	const float hi = lo + random.uniform(0.0f, 1.5f);
+	const float dx = random.uniform(-200.0f, 200.0f);
+	const float dy = random.uniform(-200.0f, 200.0f);
+	const float scale = 1.0f / random.uniform(16.0f, 300.0f);
+	const bool threshold = random.chance(0.5f);
+
+	const Kernels* base = isaKernels(ISA_SSE2);
+	for (int isa = ISA_SSE2 + 1; isa < ISA_COUNT; isa++){
+		const Kernels* k = isaKernels(Isa(isa));
+		if (!k)
+			continue;
+		int bad = 0;
+		std::vector<float> want(entries), got(entries);
+		base->minLevels(&want[0], count, levels);
+		k->minLevels(&got[0], count, levels);
+		bad += !sameBits(want, got);
+		want = got = entries;
+		base->maxLevels(&want[0], count, levels);
+		k->maxLevels(&got[0], count, levels);
+		bad += !sameBits(want, got);
+
+		want.assign(n, 0.0f);
+		got.assign(n, 0.0f);
+		base->fillRamp(&want[0], n, start, step, lo, hi);
+		k->fillRamp(&got[0], n, start, step, lo, hi);
+		bad += !sameBits(want, got);
+		base->fillRadial(&want[0], n, dx, dy, scale);
+		k->fillRadial(&got[0], n, dx, dy, scale);
+		bad += !sameBits(want, got);
+		base->lookupTable(&t[0], n, &table[0], size, &want[0]);
+		k->lookupTable(&t[0], n, &table[0], size, &got[0]);
+		bad += !sameBits(want, got);
+
+		std::vector<uint64_t> wantBits((n + 63) / 64), gotBits(wantBits.size());
+		const bool wantPacked = base->packBits(&binary[0], n, &wantBits[0], threshold);
+		const bool gotPacked = k->packBits(&binary[0], n, &gotBits[0], threshold);
+		bad += wantPacked != gotPacked || (wantPacked && wantBits != gotBits);
+
+		check(!bad, format("%s kernels count %d n %d: %d differ from sse2", isaName(Isa(isa)), count, n, bad));
+	}
+}
+
+//! Depth keys sort as their floats, signs and infinities included.
+static void testOrderedFloat(Random& random)
+{
+	static const float SPECIAL[] = { 0.0f, 1e-40f, -1e-40f, 1.0f, -1.0f, 1e30f, -1e30f };
+	int bad = 0;
+	for (int i=0; i < 1000; i++){
+		float a = random.uniform(-100.0f, 100.0f);
+		float b = random.chance(0.1f) ? a : random.uniform(-100.0f, 100.0f);
+		if (random.chance(0.2f))
+			a = SPECIAL[random.range(0, 6)];
+		if (random.chance(0.2f))
+			b = random.chance(0.5f) ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+		bad += (a < b) != (orderedFloat(a) < orderedFloat(b));
+		bad += (a == b) != (orderedFloat(a) == orderedFloat(b));
+	}
+	check(!bad, format("orderedFloat: %d pairs out of order", bad));
+}
+
+//! Push-pull leaves the covered pixels alone and fills within their range.
+static void testPushPull(Random& random)
+{
+	const int width = random.range(1, 70);
+	const int height = random.range(1, 70);
+	const float density = random.chance(0.1f) ? 0.0f : random.uniform(0.0f, 1.0f);
+	const size_t size = (size_t)width * height;
+	std::vector<float> coverage(size), values(2 * size);
+	for (size_t p=0; p < size; p++){
+		coverage[p] = random.chance(density) ? 1.0f : 0.0f;
+		values[p] = random.uniform(-1.0f, 1.0f);
+		values[size + p] = random.uniform(0.0f, 10.0f);
+	}
+	std::vector<float> got(values);
+	float* planes[2] = { &got[0], &got[size] };
+	pushPull(planes, 2, &coverage[0], width, height);
+
+	int bad = 0;
+	for (int c=0; c < 2; c++){
+		float lo = std::numeric_limits<float>::max(), hi = -lo;
+		for (size_t p=0; p < size; p++){
+			if (coverage[p]){
+				lo = std::min(lo, values[c * size + p]);
+				hi = std::max(hi, values[c * size + p]);
+			}
+		}
+		if (lo > hi)
+			lo = hi = 0.0f;
+		for (size_t p=0; p < size; p++){
+			const float g = got[c * size + p];
+			bad += coverage[p] ? g != values[c * size + p] : !(g >= lo - 1e-5f && g <= hi + 1e-5f);
+		}
+	}
+	check(!bad, format("pushPull %dx%d density %g: %d pixels wrong", width, height, density, bad));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct Test {
+	const char* name;
+	void (*run)(Random&);
+};
+
+static const Test TESTS[] = {
+	{ "tables", testTables },
+	{ "packBits", testPackBits },
+	{ "windowLine", testWindowLine },
+	{ "transpose", testTranspose },
+	{ "distanceTransform", testDistanceTransform },
+	{ "rampKernels", testRampKernels },
+	{ "isas", testIsas },
+	{ "orderedFloat", testOrderedFloat },
+	{ "pushPull", testPushPull },
+	{ "dilateBox", testDilateBox },
+	{ "dilateRound", testDilateRound },
+	{ "warp", testWarp },
+	{ "warpFill", testWarpFill },
+	{ "warpFillBackward", testWarpFillBackward },
+	{ "ramp", testRamp },
+	{ 0, 0 }
+};
+
+int main(int argc, char** argv)
+{
+	unsigned seed = 1;
+	int iterations = 40;
+	const char* filter = 0;
+	for (int i=1; i < argc; i++){
+		if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+			seed = strtoul(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+			iterations = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+			filter = argv[++i];
+		else {
+			fputs(USAGE, stderr);
+			return 2;
+		}
+	}
+
+	// NKTOOLS_ISA=sse2 runs the nodes on the narrowest kernels
+	printf("kernels            %s\n", isaName(kernels().isa));
+	for (const Test* test = TESTS; test->name; test++){
+		if (filter && !strstr(test->name, filter))
+			continue;
+		const int before = failures;
+		for (int i=0; i < iterations; i++){
+			// each case gets its own seed, so a failure can be rerun alone
+			// with --seed and --iterations 1
+			const int failed = failures;
+			Random random(seed + i);
+			// the nodes' own passes split over one to four threads
+			Thread::numThreads = 1 + (seed + i) % 4;
+			test->run(random);
+			if (failures != failed)
+				printf("  (%s, seed %u)\n", test->name, seed + i);
+		}
+		printf("%-18s %s\n", test->name, failures == before ? "ok" : "FAILED");
+	}
+	printf("%d checks, %d failed\n", checks, failures);
+	return failures ? 1 : 0;
+}